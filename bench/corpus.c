@@ -0,0 +1,364 @@
+#include "corpus.h"
+#include "json_write.h"
+#include "json_gen_num.h"
+
+typedef struct {
+    uint64_t state;
+} Rng;
+
+// splitmix64.
+static uint64_t rng_next(Rng *r)
+{
+    uint64_t z = (r->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rng_below(Rng *r, uint64_t n)
+{
+    return rng_next(r) % n;
+}
+
+static const char *rng_pick(Rng *r, const char *const *xs, size_t nxs)
+{
+    return xs[rng_below(r, nxs)];
+}
+
+static void write_qnum(JsonWriter *w, uint64_t x, uint8_t scale)
+{
+    char tmp[64];
+    int n = json_gen_unum(tmp, x, scale);
+    json_write_str(w, tmp, n);
+}
+
+static void write_kstr(JsonWriter *w, const char *key, const char *s)
+{
+    json_write_key(w, key, strlen(key));
+    json_write_str(w, s, strlen(s));
+}
+
+static void write_kqnum(JsonWriter *w, const char *key, uint64_t x, uint8_t scale)
+{
+    json_write_key(w, key, strlen(key));
+    write_qnum(w, x, scale);
+}
+
+static void write_kinum(JsonWriter *w, const char *key, int64_t x)
+{
+    json_write_key(w, key, strlen(key));
+    json_write_inum(w, x, 0);
+}
+
+static void write_kbool(JsonWriter *w, const char *key, bool x)
+{
+    json_write_key(w, key, strlen(key));
+    json_write_bool(w, x);
+}
+
+static const char *const ORDERS_KEYS[] = {"s", "i", "X", "p", "q", "z", "T"};
+
+static void gen_order(JsonWriter *w, Rng *r, uint64_t seq)
+{
+    static const char *const symbols[] = {"BTCUSDT", "ETHUSDT", "SOLUSDT", "XRPUSDT", "DOGEUSDT"};
+    static const char *const statuses[] = {"NEW", "PARTIALLY_FILLED", "FILLED", "CANCELED"};
+    static const char *const types[] = {"LIMIT", "MARKET", "STOP_LOSS_LIMIT"};
+
+    uint64_t ts = 1700000000000ull + seq * 37 + rng_below(r, 37);
+    uint64_t qty = 1 + rng_below(r, 100000000);
+    uint64_t filled = rng_below(r, qty + 1);
+    char clordid[32];
+    snprintf(clordid, sizeof(clordid), "web_%016" PRIx64, rng_next(r));
+
+    json_write_obj_begin(w);
+    write_kstr(w, "e", "executionReport");
+    write_kinum(w, "E", ts + 3);
+    write_kstr(w, "s", rng_pick(r, symbols, array_size(symbols)));
+    write_kstr(w, "c", clordid);
+    write_kstr(w, "S", rng_below(r, 2) ? "BUY" : "SELL");
+    write_kstr(w, "o", rng_pick(r, types, array_size(types)));
+    write_kstr(w, "f", "GTC");
+    write_kqnum(w, "q", qty, 8);
+    write_kqnum(w, "p", 100000 + rng_below(r, 5000000000ull), 8);
+    write_kstr(w, "X", rng_pick(r, statuses, array_size(statuses)));
+    write_kinum(w, "i", 4000000000ll + seq);
+    write_kqnum(w, "l", filled / 2, 8);
+    write_kqnum(w, "z", filled, 8);
+    write_kqnum(w, "L", 100000 + rng_below(r, 5000000000ull), 8);
+    write_kqnum(w, "n", rng_below(r, 100000), 8);
+    write_kstr(w, "N", "BNB");
+    write_kinum(w, "T", ts);
+    write_kinum(w, "t", 90000000ll + seq);
+    write_kbool(w, "m", rng_below(r, 2));
+    write_kbool(w, "M", true);
+    json_write_obj_end(w);
+}
+
+static const char *const BOOK_KEYS[] = {"lastUpdateId", "bids", "asks"};
+
+enum { BOOK_DEPTH = 2000 };
+
+static void gen_book_side(JsonWriter *w, Rng *r, const char *key, uint64_t mid, int dir)
+{
+    json_write_key(w, key, strlen(key));
+    json_write_arr_begin(w);
+    uint64_t px = mid;
+    for (int i = 0; i < BOOK_DEPTH; ++i) {
+        px += dir * (int64_t) (1 + rng_below(r, 50));
+        json_write_arr_begin(w);
+        write_qnum(w, px, 2);
+        write_qnum(w, 1 + rng_below(r, 100000000), 8);
+        json_write_arr_end(w);
+    }
+    json_write_arr_end(w);
+}
+
+static void gen_book(JsonWriter *w, Rng *r, uint64_t seq)
+{
+    uint64_t mid = 3000000 + rng_below(r, 200000);
+    json_write_obj_begin(w);
+    write_kinum(w, "lastUpdateId", 160000000000ll + seq * 1000);
+    gen_book_side(w, r, "bids", mid, -1);
+    gen_book_side(w, r, "asks", mid, +1);
+    json_write_obj_end(w);
+}
+
+static const char *const FLOATS_KEYS[] = {"id", "t", "data"};
+
+enum { FLOATS_PER_MSG = 8192 };
+
+static void gen_floats(JsonWriter *w, Rng *r, uint64_t seq)
+{
+    json_write_obj_begin(w);
+    write_kinum(w, "id", seq);
+    write_kinum(w, "t", 1700000000000ll + seq);
+    json_write_key(w, "data", 4);
+    json_write_arr_begin(w);
+    for (int i = 0; i < FLOATS_PER_MSG; ++i) {
+        int64_t x = (int64_t) rng_below(r, 2000000000) - 1000000000;
+        if (rng_below(r, 16) == 0) {
+            // Some producers switch to the exponent form for very small or large values.
+            char tmp[32];
+            int n = snprintf(tmp, sizeof(tmp), "%.6e", x * 1e-12);
+            json_write_raw(w, (JsonSpan) {tmp, tmp + n});
+        } else {
+            json_write_inum(w, x, 1 + rng_below(r, 8));
+        }
+    }
+    json_write_arr_end(w);
+    json_write_obj_end(w);
+}
+
+static const char *const TEXT_KEYS[] = {"id", "title", "author"};
+
+static const char *const ASCII_WORDS[] = {
+    "order", "book", "market", "price", "the", "of", "and", "liquidity", "spread", "venue",
+    "latency", "a", "to", "in", "matching", "engine", "session", "quote", "is", "trade",
+};
+
+static const char *const UTF8_WORDS[] = {
+    "caf\xc3\xa9", "na\xc3\xafve", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e",
+    "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xf0\x9f\x93\x88", "Stra\xc3\x9f" "e",
+};
+
+// Words that need escaping; 'json_write_str()' escapes the control bytes as '\u00XX'.
+static const char *const ESC_WORDS[] = {
+    "\"quoted\"", "C:\\Users\\trader", "line\nbreak", "tab\tsep", "</script>", "back\\slash",
+    "\x01", "say \"hi\"\r\n",
+};
+
+static void gen_text(char *out, size_t nout, Rng *r, size_t nwords, bool escapes)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < nwords; ++i) {
+        const char *word;
+        uint64_t x = rng_below(r, 8);
+        if (escapes && x < 3) {
+            word = rng_pick(r, ESC_WORDS, array_size(ESC_WORDS));
+        } else if (x == 3) {
+            word = rng_pick(r, UTF8_WORDS, array_size(UTF8_WORDS));
+        } else {
+            word = rng_pick(r, ASCII_WORDS, array_size(ASCII_WORDS));
+        }
+        size_t nword = strlen(word);
+        if (n + nword + 2 > nout)
+            break;
+        if (i) {
+            out[n++] = ' ';
+        }
+        memcpy(out + n, word, nword);
+        n += nword;
+    }
+    out[n] = '\0';
+}
+
+static void gen_doc(JsonWriter *w, Rng *r, uint64_t seq, bool escapes)
+{
+    char text[1024];
+
+    json_write_obj_begin(w);
+    write_kinum(w, "id", seq);
+    gen_text(text, sizeof(text), r, 4 + rng_below(r, 8), escapes);
+    write_kstr(w, "title", text);
+    gen_text(text, sizeof(text), r, 60 + rng_below(r, 60), escapes);
+    write_kstr(w, "body", text);
+    gen_text(text, sizeof(text), r, 2, escapes);
+    write_kstr(w, "author", text);
+    json_write_key(w, "tags", 4);
+    json_write_arr_begin(w);
+    for (uint64_t i = 0, n = rng_below(r, 5); i < n; ++i) {
+        gen_text(text, sizeof(text), r, 1, escapes);
+        json_write_str(w, text, strlen(text));
+    }
+    json_write_arr_end(w);
+    write_kstr(w, "lang", rng_below(r, 2) ? "en" : "de");
+    json_write_obj_end(w);
+}
+
+static void gen_strings(JsonWriter *w, Rng *r, uint64_t seq)
+{
+    gen_doc(w, r, seq, false);
+}
+
+static void gen_escapes(JsonWriter *w, Rng *r, uint64_t seq)
+{
+    gen_doc(w, r, seq, true);
+}
+
+typedef struct {
+    const char *name;
+    void (*gen)(JsonWriter *w, Rng *r, uint64_t seq);
+    size_t nmsgs;
+    const char *const *keys;
+    int nkeys;
+} KindInfo;
+
+static const KindInfo KINDS[] = {
+    [CORPUS_ORDERS]  = {"orders", gen_order, 16384, ORDERS_KEYS, array_size(ORDERS_KEYS)},
+    [CORPUS_BOOK]    = {"book", gen_book, 24, BOOK_KEYS, array_size(BOOK_KEYS)},
+    [CORPUS_FLOATS]  = {"floats", gen_floats, 32, FLOATS_KEYS, array_size(FLOATS_KEYS)},
+    [CORPUS_STRINGS] = {"strings", gen_strings, 4096, TEXT_KEYS, array_size(TEXT_KEYS)},
+    [CORPUS_ESCAPES] = {"escapes", gen_escapes, 4096, TEXT_KEYS, array_size(TEXT_KEYS)},
+};
+
+const char *corpus_kind_name(CorpusKind kind)
+{
+    return KINDS[kind].name;
+}
+
+static char *reserve(Corpus *c, size_t *cap, size_t n)
+{
+    while (*cap - c->nbuf < n) {
+        c->buf = x2realloc_or_die(c->buf, cap, sizeof(char));
+    }
+    return c->buf + c->nbuf;
+}
+
+static void put_indent(Corpus *c, size_t *cap, size_t depth)
+{
+    char *p = reserve(c, cap, 1 + 2 * depth);
+    *p++ = '\n';
+    memset(p, ' ', 2 * depth);
+    c->nbuf += 1 + 2 * depth;
+}
+
+// Appends the minified message {s ... s_end} pretty-printed.
+static void put_pretty(Corpus *c, size_t *cap, const char *s, const char *s_end)
+{
+    size_t depth = 0;
+    while (s != s_end) {
+        char ch = *s++;
+        switch (ch) {
+        case '"':
+            {
+                const char *str = s - 1;
+                for (; *s != '"'; ++s) {
+                    if (*s == '\\') {
+                        ++s;
+                    }
+                }
+                ++s;
+                memcpy(reserve(c, cap, s - str), str, s - str);
+                c->nbuf += s - str;
+            }
+            break;
+        case '{':
+        case '[':
+            *reserve(c, cap, 1) = ch;
+            ++c->nbuf;
+            if (*s == ch + 2) {
+                // Empty.
+                *reserve(c, cap, 1) = *s++;
+                ++c->nbuf;
+            } else {
+                put_indent(c, cap, ++depth);
+            }
+            break;
+        case '}':
+        case ']':
+            put_indent(c, cap, --depth);
+            *reserve(c, cap, 1) = ch;
+            ++c->nbuf;
+            break;
+        case ',':
+            *reserve(c, cap, 1) = ch;
+            ++c->nbuf;
+            put_indent(c, cap, depth);
+            break;
+        case ':':
+            memcpy(reserve(c, cap, 2), ": ", 2);
+            c->nbuf += 2;
+            break;
+        default:
+            *reserve(c, cap, 1) = ch;
+            ++c->nbuf;
+        }
+    }
+}
+
+void corpus_gen(Corpus *c, CorpusKind kind, bool pretty, uint64_t seed)
+{
+    const KindInfo *info = &KINDS[kind];
+    *c = (Corpus) {
+        .kind = kind,
+        .pretty = pretty,
+        .keys = info->keys,
+        .nkeys = info->nkeys,
+    };
+    size_t cap = 0;
+    size_t *offsets = malloc_or_die(info->nmsgs + 1, sizeof(size_t));
+
+    Rng r = {seed ^ ((uint64_t) kind << 56)};
+    JsonWriter w;
+    json_writer_init(&w, NULL, 0, 0);
+    for (size_t i = 0; i < info->nmsgs; ++i) {
+        json_writer_reset(&w);
+        info->gen(&w, &r, i);
+        JsonSpan m = json_writer_span(&w);
+        offsets[i] = c->nbuf;
+        if (pretty) {
+            put_pretty(c, &cap, m.begin, m.end);
+        } else {
+            memcpy(reserve(c, &cap, m.end - m.begin), m.begin, m.end - m.begin);
+            c->nbuf += m.end - m.begin;
+        }
+        *reserve(c, &cap, 1) = '\n';
+        ++c->nbuf;
+    }
+    json_writer_destroy(&w);
+
+    c->nmsgs = info->nmsgs;
+    c->msgs = malloc_or_die(c->nmsgs, sizeof(JsonSpan));
+    for (size_t i = 0; i < c->nmsgs; ++i) {
+        size_t end = i + 1 == c->nmsgs ? c->nbuf : offsets[i + 1];
+        // Exclude the '\n'.
+        c->msgs[i] = (JsonSpan) {c->buf + offsets[i], c->buf + end - 1};
+    }
+    free(offsets);
+}
+
+void corpus_free(Corpus *c)
+{
+    free(c->buf);
+    free(c->msgs);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+
+// Deterministic generator of benchmark corpora: the same kind and seed always produce the same
+// bytes, so that the results of different commits can be compared.
+
+typedef enum {
+    // Exchange-style order and execution reports: many small flat dicts, with most numbers quoted.
+    CORPUS_ORDERS,
+    // Deep order book snapshots: two long arrays of [price, qty] pairs per message.
+    CORPUS_BOOK,
+    // Large arrays of unquoted floats.
+    CORPUS_FLOATS,
+    // Dicts of long ASCII and UTF-8 strings without escapes.
+    CORPUS_STRINGS,
+    // Dicts of strings where escapes are frequent.
+    CORPUS_ESCAPES,
+
+    CORPUS_NKINDS,
+} CorpusKind;
+
+typedef struct {
+    CorpusKind kind;
+    bool pretty;
+    // The messages, each followed by '\n'.
+    char *buf;
+    size_t nbuf;
+    JsonSpan *msgs;
+    size_t nmsgs;
+    // The top-level keys of each message a consumer would typically extract.
+    const char *const *keys;
+    int nkeys;
+} Corpus;
+
+const char *corpus_kind_name(CorpusKind kind);
+
+// Generates the corpus of the given kind, either minified or pretty-printed with two-space
+// indentation; both contain the same messages.
+void corpus_gen(Corpus *c, CorpusKind kind, bool pretty, uint64_t seed);
+
+void corpus_free(Corpus *c);
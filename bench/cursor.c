@@ -0,0 +1,98 @@
+// Compares looking up the elements of a large array one by one, in increasing and in random
+// order, with 'json_parse_array_elems_sparse()' (a rescan from the beginning per lookup) and with
+// 'json_cursor_array_at()'.
+
+#include "json_visit.h"
+
+enum {
+    NELEMS = 20000,
+    NLOOKUPS = 20000,
+    NROUNDS = 5,
+};
+
+static char *buf;
+static JsonSpan arr;
+static size_t order_inc[NLOOKUPS];
+static size_t order_rand[NLOOKUPS];
+
+static void gen(void)
+{
+    size_t cap = (size_t) NELEMS * 32 + 16;
+    buf = malloc_or_die(cap, 1);
+    size_t n = 0;
+    buf[n++] = '[';
+    for (int i = 0; i < NELEMS; ++i) {
+        n += sprintf(buf + n, "%s[\"%d.%02d\", \"%d\"]", i ? ", " : "", 60000 + i, i % 100, i % 77);
+    }
+    buf[n++] = ']';
+    arr = (JsonSpan) {buf, buf + n};
+
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < NLOOKUPS; ++i) {
+        order_inc[i] = i * NELEMS / NLOOKUPS;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        order_rand[i] = x % NELEMS;
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t by_rescan(const size_t *order, size_t n)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < n; ++i) {
+        JsonSparseElemEntry e = {order[i], NULL, NULL};
+        if (json_parse_array_elems_sparse(arr.begin, arr.end, &e, 1) < 0)
+            abort();
+        r += e.v_end - e.v_begin;
+    }
+    return r;
+}
+
+static uint64_t by_cursor(const size_t *order, size_t n)
+{
+    JsonCursorMark marks[JSON_CURSOR_DEFAULT_NMARKS];
+    JsonCursor cur = json_cursor_new(arr, marks, JSON_CURSOR_DEFAULT_NMARKS, JSON_CURSOR_DEFAULT_EVERY);
+    uint64_t r = 0;
+    for (size_t i = 0; i < n; ++i) {
+        JsonSpan e;
+        if (json_cursor_array_at(&cur, order[i], &e) <= 0)
+            abort();
+        r += e.end - e.begin;
+    }
+    return r;
+}
+
+static void run(const char *name, uint64_t (*f)(const size_t *order, size_t n), const size_t *order, size_t n)
+{
+    uint64_t r = 0;
+    double best = -1;
+    for (int k = 0; k < NROUNDS; ++k) {
+        double t0 = now_ns();
+        r = f(order, n);
+        double t = now_ns() - t0;
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    printf("%-18s %10.1f ns per lookup (%" PRIu64 ")\n", name, best / n, r);
+}
+
+int main()
+{
+    gen();
+    // Rescanning is quadratic; a tenth of the lookups is enough to tell.
+    run("rescan, in order", by_rescan, order_inc, NLOOKUPS / 10);
+    run("cursor, in order", by_cursor, order_inc, NLOOKUPS / 10);
+    run("rescan, random", by_rescan, order_rand, NLOOKUPS / 10);
+    run("cursor, random", by_cursor, order_rand, NLOOKUPS / 10);
+    run("cursor, random x10", by_cursor, order_rand, NLOOKUPS);
+    return 0;
+}
@@ -0,0 +1,51 @@
+// Measures the cost of a fiber_kick()/fiber_yield() round trip.
+// Built once per fiber backend by './run'; FIBER_BACKEND_NAME names the one being measured.
+
+#include "fiber.h"
+
+#ifndef FIBER_BACKEND_NAME
+# define FIBER_BACKEND_NAME "default"
+#endif
+
+enum { NROUNDS = 2 * 1000 * 1000 };
+
+typedef struct {
+    uint64_t n;
+    bool done;
+} State;
+
+static void fiber_main(FIBER_PARAM_LIST)
+{
+    State *st = FIBER_GET_USERDATA();
+    FiberParams fib_par = FIBER_GET_PARAMS();
+    for (uint64_t i = 0; i < NROUNDS; ++i) {
+        ++st->n;
+        fiber_yield(&fib_par);
+    }
+    st->done = true;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static Fiber fib;
+
+int main()
+{
+    State st = {0};
+    fiber_create(&fib, fiber_main, &st);
+
+    double t0 = now_ns();
+    while (!st.done) {
+        fiber_kick(&fib);
+    }
+    double t1 = now_ns();
+
+    printf("%-10s %8.1f ns per kick/yield round trip (%" PRIu64 " rounds)\n",
+           FIBER_BACKEND_NAME, (t1 - t0) / NROUNDS, st.n);
+    return 0;
+}
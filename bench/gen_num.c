@@ -0,0 +1,123 @@
+// Compares json_gen_unum() against the previous implementation (one division by 10 per digit),
+// copied below.
+
+#include "common.h"
+#include "json_gen_num.h"
+
+static inline size_t ref_getndigits(uint64_t x)
+{
+    size_t result = 0;
+    for (;;) {
+        if (x < 10) return result + 1;
+        if (x < 100) return result + 2;
+        if (x < 1000) return result + 3;
+        if (x < 10000) return result + 4;
+        x /= 10000;
+        result += 4;
+    }
+}
+
+static int ref_gen0(char *out, uint8_t scale)
+{
+    if (scale) {
+        out[0] = '0';
+        out[1] = '.';
+        size_t s = scale;
+        for (size_t i = 0; i < s; ++i) {
+            // Prevent gcc from emitting 'rep stos': rep stos/movs has significant startup overhead.
+            asm volatile ("" ::: "memory");
+
+            out[2 + i] = '0';
+        }
+        return s + 2;
+    } else {
+        *out = '0';
+        return 1;
+    }
+}
+
+static int ref_gen_unum(char *out, uint64_t x, uint8_t scale)
+{
+    if (x == 0) {
+        return ref_gen0(out, scale);
+    }
+
+    // Calculate the number of characters to be written without '.': max(getndigits(x), scale+1).
+    size_t r = ref_getndigits(x);
+    if (r <= scale)
+        r = scale + 1;
+
+    char *end;
+    if (scale) {
+        // We're going to write '.', so increment 'r' by one.
+        ++r;
+        end = out + r;
+        char *boundary = end - scale;
+        do {
+            --end;
+            *end = '0' + (x % 10);
+            x /= 10;
+        } while (end != boundary);
+        --end;
+        *end = '.';
+    } else {
+        end = out + r;
+    }
+
+    char *boundary = out + 1;
+    while (end != boundary) {
+        --end;
+        *end = '0' + (x % 10);
+        x /= 10;
+    }
+    *out = '0' + x;
+
+    return r;
+}
+
+enum { NVALUES = 1024, NROUNDS = 2000 };
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main()
+{
+    // Prices and quantities: 3 to 12 digits.
+    static uint64_t xs[NVALUES];
+    uint64_t seed = 1;
+    for (int i = 0; i < NVALUES; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        xs[i] = (seed >> 20) % 1000000000000ull;
+    }
+
+    static const uint8_t SCALES[] = {0, 2, 8};
+    char out[64];
+    volatile int sink = 0;
+    for (size_t k = 0; k < array_size(SCALES); ++k) {
+        uint8_t scale = SCALES[k];
+
+        double t0 = now_ns();
+        for (int r = 0; r < NROUNDS; ++r) {
+            for (int i = 0; i < NVALUES; ++i) {
+                sink += ref_gen_unum(out, xs[i], scale);
+            }
+        }
+        double t1 = now_ns();
+        for (int r = 0; r < NROUNDS; ++r) {
+            for (int i = 0; i < NVALUES; ++i) {
+                sink += json_gen_unum(out, xs[i], scale);
+            }
+        }
+        double t2 = now_ns();
+
+        printf("gen_unum scale=%d: old %6.2f ns, new %6.2f ns per number\n",
+               (int) scale,
+               (t1 - t0) / ((double) NROUNDS * NVALUES),
+               (t2 - t1) / ((double) NROUNDS * NVALUES));
+    }
+    return 0;
+}
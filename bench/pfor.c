@@ -0,0 +1,116 @@
+// Compares a sequential 'json_array_next()' loop over a large array with 'json_pfor()' on pools
+// of increasing size, with a per-element body that extracts and converts a few fields.
+
+#include "json_visit.h"
+#include "json_parse_num.h"
+#include "json_pfor.h"
+
+enum {
+    NELEMS = 200000,
+    NROUNDS = 10,
+};
+
+static char *buf;
+static JsonSpan arr;
+
+static void gen_array(void)
+{
+    size_t cap = (size_t) NELEMS * 128 + 16;
+    buf = malloc_or_die(cap, 1);
+    size_t n = 0;
+    buf[n++] = '[';
+    for (int i = 0; i < NELEMS; ++i) {
+        n += sprintf(
+            buf + n,
+            "%s{\"s\": \"SYM%05d\", \"px\": \"%d.%02d\", \"qty\": \"%d.%03d\", \"side\": \"%s\"}",
+            i ? ", " : "", i % 100000, 100 + i % 9000, i % 100, i % 50, i % 1000,
+            i % 2 ? "Buy" : "Sell");
+    }
+    buf[n++] = ']';
+    arr = (JsonSpan) {buf, buf + n};
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int64_t *notional;
+
+static void body(void *arg, JsonSpan e, size_t i, int worker)
+{
+    (void) arg;
+    (void) worker;
+    JsonFieldEntry f[] = {JSON_FENTRY("px"), JSON_FENTRY("qty"), JSON_FENTRY("side")};
+    if (json_parse_dict_fields(e.begin, e.end, f, 3) < 0)
+        abort();
+    int64_t px = json_parse_num(f[0].v_begin + 1, f[0].v_end - 1, 2);
+    int64_t qty = json_parse_num(f[1].v_begin + 1, f[1].v_end - 1, 3);
+    notional[i] = f[2].v_begin[1] == 'B' ? px * qty : -px * qty;
+}
+
+static int64_t checksum(void)
+{
+    int64_t r = 0;
+    for (size_t i = 0; i < NELEMS; ++i) {
+        r += notional[i];
+    }
+    return r;
+}
+
+static void report(const char *name, double best)
+{
+    printf("%-12s %6.2f GB/s, %6.1f ns per element (%" PRId64 ")\n",
+           name, (double) (arr.end - arr.begin) / best, best / NELEMS, checksum());
+}
+
+static void run_sequential(void)
+{
+    double best = -1;
+    for (int k = 0; k < NROUNDS; ++k) {
+        double t0 = now_ns();
+        size_t i = 0;
+        for (JsonSpan e = {0}; json_array_next(arr, &e) > 0; ++i) {
+            body(NULL, e, i, 0);
+        }
+        double t = now_ns() - t0;
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    report("sequential", best);
+}
+
+static void run_pfor(int nworkers)
+{
+    WorkPool *wp = workpool_new(nworkers);
+    double best = -1;
+    for (int k = 0; k < NROUNDS; ++k) {
+        double t0 = now_ns();
+        if (json_pfor(wp, arr, 0, body, NULL, NULL, 0) < 0)
+            abort();
+        double t = now_ns() - t0;
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    workpool_free(wp);
+
+    char name[32];
+    snprintf(name, sizeof(name), "pfor x%d", nworkers);
+    report(name, best);
+}
+
+int main()
+{
+    gen_array();
+    notional = calloc_or_die(NELEMS, sizeof(int64_t));
+    run_sequential();
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int n = 1; n <= ncpus && n <= 16; n *= 2) {
+        run_pfor(n);
+    }
+    return 0;
+}
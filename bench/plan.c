@@ -0,0 +1,100 @@
+// Compares extracting fields from nested messages level by level (a 'json_parse_dict_fields()'
+// call per dict, each rescanning the value found by the previous one) with a single
+// 'json_parse_plan()' pass.
+
+#include "json_visit.h"
+
+enum {
+    NMSGS = 100000,
+    NROUNDS = 20,
+};
+
+static char *buf;
+static JsonSpan msgs[NMSGS];
+static size_t nbuf;
+
+static void gen_msgs(void)
+{
+    size_t cap = (size_t) NMSGS * 768;
+    buf = malloc_or_die(cap, 1);
+    size_t n = 0;
+    for (int i = 0; i < NMSGS; ++i) {
+        const char *begin = buf + n;
+        n += sprintf(
+            buf + n,
+            "{\"stream\": \"btcusdt@order\", \"data\": {\"e\": \"ORDER_TRADE_UPDATE\", "
+            "\"E\": %d, \"T\": %d, \"o\": {\"s\": \"BTCUSDT\", \"c\": \"web_%08x\", "
+            "\"S\": \"BUY\", \"o\": \"LIMIT\", \"f\": \"GTC\", \"q\": \"0.%03d\", "
+            "\"p\": \"%d.10\", \"ap\": \"0\", \"sp\": \"0\", \"x\": \"NEW\", \"X\": \"NEW\", "
+            "\"i\": %d, \"l\": \"0\", \"z\": \"0\", \"L\": \"0\", \"n\": \"0\", \"N\": \"USDT\", "
+            "\"T\": %d, \"t\": 0, \"b\": \"0\", \"a\": \"0\", \"m\": false, \"R\": false, "
+            "\"wt\": \"CONTRACT_PRICE\", \"ot\": \"LIMIT\", \"ps\": \"BOTH\", \"cp\": false, "
+            "\"rp\": \"0\"}}}",
+            1700000000 + i, 1700000000 + i, (unsigned) i * 2654435761u, i % 1000,
+            60000 + i % 5000, 800000000 + i, 1700000000 + i);
+        msgs[i] = (JsonSpan) {begin, buf + n};
+    }
+    nbuf = n;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t by_level(JsonSpan m)
+{
+    JsonFieldEntry root[] = {JSON_FENTRY("stream"), JSON_FENTRY("data")};
+    if (json_parse_dict_fields(m.begin, m.end, root, 2) < 0)
+        abort();
+    JsonFieldEntry data[] = {JSON_FENTRY("E"), JSON_FENTRY("o")};
+    if (json_parse_dict_fields(root[1].v_begin, root[1].v_end, data, 2) < 0)
+        abort();
+    JsonFieldEntry o[] = {JSON_FENTRY("s"), JSON_FENTRY("p"), JSON_FENTRY("q"), JSON_FENTRY("X"), JSON_FENTRY("i")};
+    if (json_parse_dict_fields(data[1].v_begin, data[1].v_end, o, 5) < 0)
+        abort();
+    return (root[0].v_end - root[0].v_begin) + (data[0].v_end - data[0].v_begin) + (o[4].v_end - o[4].v_begin);
+}
+
+static uint64_t by_plan(JsonSpan m)
+{
+    JsonFieldEntry root[] = {JSON_FENTRY("stream"), JSON_FENTRY("data")};
+    JsonFieldEntry data[] = {JSON_FENTRY("E"), JSON_FENTRY("o")};
+    JsonFieldEntry o[] = {JSON_FENTRY("s"), JSON_FENTRY("p"), JSON_FENTRY("q"), JSON_FENTRY("X"), JSON_FENTRY("i")};
+    const JsonPlan o_plan = {.kind = JSON_PLAN_DICT, .nentries = 5, .fields = o};
+    const JsonPlan *const data_sub[] = {NULL, &o_plan};
+    const JsonPlan data_plan = {.kind = JSON_PLAN_DICT, .nentries = 2, .fields = data, .sub = data_sub};
+    const JsonPlan *const root_sub[] = {NULL, &data_plan};
+    const JsonPlan root_plan = {.kind = JSON_PLAN_DICT, .nentries = 2, .fields = root, .sub = root_sub};
+    if (json_parse_plan(m.begin, m.end, &root_plan) < 0)
+        abort();
+    return (root[0].v_end - root[0].v_begin) + (data[0].v_end - data[0].v_begin) + (o[4].v_end - o[4].v_begin);
+}
+
+static void run(const char *name, uint64_t (*f)(JsonSpan m))
+{
+    uint64_t r = 0;
+    double best = -1;
+    for (int k = 0; k < NROUNDS; ++k) {
+        double t0 = now_ns();
+        for (int i = 0; i < NMSGS; ++i) {
+            r += f(msgs[i]);
+        }
+        double t = now_ns() - t0;
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    printf("%-9s %6.2f GB/s, %5.1f ns per message (%" PRIu64 ")\n",
+           name, (double) nbuf / best, best / NMSGS, r / NROUNDS);
+}
+
+int main()
+{
+    gen_msgs();
+    run("by level", by_level);
+    run("plan", by_plan);
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Compares the throughput of the plain and the preemptible ('PREEMPT_*') parsers on a large
+// message, the latter running in a fiber that is kicked again after every yield, with a
+// step-counting and a timed preempt device; for these, also reports the time between yields.
+
+#include "json_visit.h"
+#include "json_visit_preempt.h"
+
+enum { NROUNDS = 50 };
+
+static char *msg;
+static size_t nmsg;
+
+static void gen_msg(void)
+{
+    size_t cap = 8 * 1024 * 1024;
+    msg = malloc_or_die(cap, 1);
+    size_t n = 0;
+    n += sprintf(msg + n, "{\"snapshot\": [");
+    for (int i = 0; n + 256 < cap - 64; ++i) {
+        n += sprintf(
+            msg + n,
+            "%s{\"id\": %d, \"px\": \"%d.25\", \"text\": \"lorem \\\"ipsum\\\" dolor sit amet\", "
+            "\"levels\": [[1, 2], [3, 4]]}",
+            i ? ", " : "", i, i * 7);
+    }
+    n += sprintf(msg + n, "], \"seq\": 12345}");
+    nmsg = n;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef struct {
+    JsonFieldEntry entries[2];
+    // 0 for a step-counting device.
+    uint64_t budget_ns;
+    uint64_t nyields;
+    bool done;
+} Job;
+
+static void job_main(FIBER_PARAM_LIST)
+{
+    Job *job = FIBER_GET_USERDATA();
+    PreemptDevice p = job->budget_ns
+        ? preempt_new_timed(job->budget_ns, 0, FIBER_GET_PARAMS())
+        : preempt_new(0, FIBER_GET_PARAMS());
+    for (int i = 0; i < NROUNDS; ++i) {
+        if (PREEMPT_json_parse_dict_fields(msg, msg + nmsg, job->entries, 2, &p) < 0) {
+            abort();
+        }
+    }
+    job->done = true;
+}
+
+static Fiber fib;
+
+static void run_preemptible(const char *name, uint64_t budget_ns)
+{
+    Job job = {.entries = {JSON_FENTRY("snapshot"), JSON_FENTRY("seq")}, .budget_ns = budget_ns};
+    fiber_create(&fib, job_main, &job);
+    double max_slice = 0;
+    double t0 = now_ns();
+    for (;;) {
+        double s0 = now_ns();
+        fiber_kick(&fib);
+        double slice = now_ns() - s0;
+        if (slice > max_slice) {
+            max_slice = slice;
+        }
+        if (job.done)
+            break;
+        ++job.nyields;
+    }
+    double t1 = now_ns();
+    printf("%-11s %6.2f GB/s (%.1f yields per MB, %.1f us between yields, max %.1f us)\n",
+           name,
+           (double) nmsg * NROUNDS / (t1 - t0),
+           job.nyields / (NROUNDS * (nmsg / 1e6)),
+           (t1 - t0) / (job.nyields + 1) / 1e3,
+           max_slice / 1e3);
+}
+
+int main()
+{
+    gen_msg();
+    // Calibrate outside of the measurements.
+    (void) ticks_per_ns();
+
+    JsonFieldEntry entries[] = {JSON_FENTRY("snapshot"), JSON_FENTRY("seq")};
+    double t0 = now_ns();
+    for (int i = 0; i < NROUNDS; ++i) {
+        if (json_parse_dict_fields(msg, msg + nmsg, entries, 2) < 0) {
+            abort();
+        }
+    }
+    double t1 = now_ns();
+    printf("plain       %6.2f GB/s\n", (double) nmsg * NROUNDS / (t1 - t0));
+
+    run_preemptible("preemptible", 0);
+    run_preemptible("timed 20us", 20 * 1000);
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Compares decoding nested messages into a C struct by extracting spans with 'json_parse_plan()'
+// and then converting them (a second pass over the values) with decoding them in a single
+// 'json_decode_record()' pass.
+
+#include "json_visit.h"
+#include "json_parse_num.h"
+
+enum {
+    NMSGS = 100000,
+    NROUNDS = 20,
+};
+
+typedef struct {
+    int64_t event_time;
+    char symbol[16];
+    char side;
+    int64_t qty;
+    int64_t price;
+    char status;
+    int64_t order_id;
+    bool maker;
+} Order;
+
+static char *buf;
+static JsonSpan msgs[NMSGS];
+static size_t nbuf;
+
+static void gen_msgs(void)
+{
+    size_t cap = (size_t) NMSGS * 768;
+    buf = malloc_or_die(cap, 1);
+    size_t n = 0;
+    for (int i = 0; i < NMSGS; ++i) {
+        const char *begin = buf + n;
+        n += sprintf(
+            buf + n,
+            "{\"stream\": \"btcusdt@order\", \"data\": {\"e\": \"ORDER_TRADE_UPDATE\", "
+            "\"E\": %d, \"T\": %d, \"o\": {\"s\": \"BTCUSDT\", \"c\": \"web_%08x\", "
+            "\"S\": \"BUY\", \"o\": \"LIMIT\", \"f\": \"GTC\", \"q\": \"0.%03d\", "
+            "\"p\": \"%d.10\", \"ap\": \"0\", \"sp\": \"0\", \"x\": \"NEW\", \"X\": \"NEW\", "
+            "\"i\": %d, \"l\": \"0\", \"z\": \"0\", \"L\": \"0\", \"n\": \"0\", \"N\": \"USDT\", "
+            "\"T\": %d, \"t\": 0, \"b\": \"0\", \"a\": \"0\", \"m\": %s, \"R\": false, "
+            "\"wt\": \"CONTRACT_PRICE\", \"ot\": \"LIMIT\", \"ps\": \"BOTH\", \"cp\": false, "
+            "\"rp\": \"0\"}}}",
+            1700000000 + i, 1700000000 + i, (unsigned) i * 2654435761u, i % 1000,
+            60000 + i % 5000, 800000000 + i, 1700000000 + i, i % 3 ? "false" : "true");
+        msgs[i] = (JsonSpan) {begin, buf + n};
+    }
+    nbuf = n;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int64_t num_or_str(JsonSpan s, uint8_t scale)
+{
+    if (!json_span_empty(s) && s.begin[0] == '"') {
+        ++s.begin;
+        --s.end;
+    }
+    return json_parse_num(s.begin, s.end, scale);
+}
+
+static uint64_t by_spans(JsonSpan m)
+{
+    JsonFieldEntry root[] = {JSON_FENTRY("data")};
+    JsonFieldEntry data[] = {JSON_FENTRY("E"), JSON_FENTRY("o")};
+    JsonFieldEntry o[] = {
+        JSON_FENTRY("s"), JSON_FENTRY("S"), JSON_FENTRY("q"), JSON_FENTRY("p"), JSON_FENTRY("X"),
+        JSON_FENTRY("i"), JSON_FENTRY("m"),
+    };
+    const JsonPlan o_plan = {.kind = JSON_PLAN_DICT, .nentries = 7, .fields = o};
+    const JsonPlan *const data_sub[] = {NULL, &o_plan};
+    const JsonPlan data_plan = {.kind = JSON_PLAN_DICT, .nentries = 2, .fields = data, .sub = data_sub};
+    const JsonPlan *const root_sub[] = {&data_plan};
+    const JsonPlan root_plan = {.kind = JSON_PLAN_DICT, .nentries = 1, .fields = root, .sub = root_sub};
+    if (json_parse_plan(m.begin, m.end, &root_plan) < 0)
+        abort();
+
+    Order r = {0};
+    r.event_time = num_or_str(json_span_from_fentry(data[0]), 0);
+    JsonSpan s = json_span_from_fentry(o[0]);
+    if (s.end - s.begin - 2 >= (ssize_t) sizeof(r.symbol))
+        abort();
+    ssize_t ns = json_unesc(s.begin, s.end, r.symbol);
+    if (ns < 0)
+        abort();
+    r.symbol[ns] = '\0';
+    r.side = o[1].v_begin[1];
+    r.qty = num_or_str(json_span_from_fentry(o[2]), 3);
+    r.price = num_or_str(json_span_from_fentry(o[3]), 2);
+    r.status = o[4].v_begin[1];
+    r.order_id = num_or_str(json_span_from_fentry(o[5]), 0);
+    r.maker = json_span_parse_bool(json_span_from_fentry(o[6])) > 0;
+    if (r.event_time == INT64_MIN || r.qty == INT64_MIN || r.price == INT64_MIN || r.order_id == INT64_MIN)
+        abort();
+    return r.event_time + r.qty + r.price + r.order_id + r.maker + r.side + r.status + r.symbol[0];
+}
+
+static const JsonFieldEntry o_keys[] = {
+    {"s", 1, NULL, NULL}, {"S", 1, NULL, NULL}, {"q", 1, NULL, NULL}, {"p", 1, NULL, NULL},
+    {"X", 1, NULL, NULL}, {"i", 1, NULL, NULL}, {"m", 1, NULL, NULL},
+};
+static const JsonRecordField o_fields[] = {
+    {JSON_RECORD_STR, 0, offsetof(Order, symbol), sizeof(((Order *) 0)->symbol), 0, NULL},
+    {JSON_RECORD_CHAR, 0, offsetof(Order, side), 0, 0, NULL},
+    {JSON_RECORD_INT, 3, offsetof(Order, qty), 0, 0, NULL},
+    {JSON_RECORD_INT, 2, offsetof(Order, price), 0, 0, NULL},
+    {JSON_RECORD_CHAR, 0, offsetof(Order, status), 0, 0, NULL},
+    {JSON_RECORD_INT, 0, offsetof(Order, order_id), 0, 0, NULL},
+    {JSON_RECORD_BOOL, 0, offsetof(Order, maker), 0, 0, NULL},
+};
+static const JsonRecord o_rec = {7, o_keys, o_fields, NULL, sizeof(Order)};
+
+static const JsonFieldEntry data_keys[] = {{"E", 1, NULL, NULL}, {"o", 1, NULL, NULL}};
+static const JsonRecordField data_fields[] = {
+    {JSON_RECORD_INT, 0, offsetof(Order, event_time), 0, 0, NULL},
+    {JSON_RECORD_DICT, 0, 0, 0, 0, &o_rec},
+};
+static const JsonRecord data_rec = {2, data_keys, data_fields, NULL, sizeof(Order)};
+
+static const JsonFieldEntry root_keys[] = {{"data", 4, NULL, NULL}};
+static const JsonRecordField root_fields[] = {{JSON_RECORD_DICT, 0, 0, 0, 0, &data_rec}};
+static const JsonRecord root_rec = {1, root_keys, root_fields, NULL, sizeof(Order)};
+
+static uint64_t by_record(JsonSpan m)
+{
+    Order r = {0};
+    if (json_decode_record(m.begin, m.end, &root_rec, &r) < 0)
+        abort();
+    return r.event_time + r.qty + r.price + r.order_id + r.maker + r.side + r.status + r.symbol[0];
+}
+
+static void run(const char *name, uint64_t (*f)(JsonSpan m))
+{
+    uint64_t r = 0;
+    double best = -1;
+    for (int k = 0; k < NROUNDS; ++k) {
+        double t0 = now_ns();
+        for (int i = 0; i < NMSGS; ++i) {
+            r += f(msgs[i]);
+        }
+        double t = now_ns() - t0;
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    printf("%-9s %6.2f GB/s, %5.1f ns per message (%" PRIu64 ")\n",
+           name, (double) nbuf / best, best / NMSGS, r / NROUNDS);
+}
+
+int main()
+{
+    gen_msgs();
+    run("spans", by_spans);
+    run("record", by_record);
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Compares reading a stream of concatenated messages from a file descriptor with 'json_ring_next()'
+// and parsing them in place, against reading into a linear buffer and copying each message out
+// before parsing it (moving the incomplete remainder to the front before each read).
+
+#include "json_ring.h"
+#include "json_visit.h"
+#include "json_parse_num.h"
+
+enum {
+    NMSGS = 200000,
+    NROUNDS = 5,
+    BUF_SIZE = 1 << 16,
+    MAX_MSG = 256,
+};
+
+static int fd;
+static size_t nbytes;
+
+static void gen(void)
+{
+    FILE *f = tmpfile();
+    if (!f)
+        abort();
+    for (int i = 0; i < NMSGS; ++i) {
+        nbytes += fprintf(f, "{\"e\": \"trade\", \"seq\": %d, \"px\": \"%d.%02d\", \"q\": %d}%s",
+                          i, 6000 + i % 500, i % 100, i % 77, i % 3 ? "" : "\n");
+    }
+    if (fflush(f) != 0)
+        abort();
+    fd = dup(fileno(f));
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int64_t parse_msg(const char *p, const char *p_end)
+{
+    JsonFieldEntry e = {"px", 2, NULL, NULL};
+    if (json_parse_dict_fields(p, p_end, &e, 1) < 0 || !e.v_begin)
+        abort();
+    return json_parse_num(e.v_begin + 1, e.v_end - 1, 2);
+}
+
+static int64_t by_ring(void)
+{
+    JsonRing r;
+    if (json_ring_init(&r, fd, BUF_SIZE) < 0)
+        abort();
+    int64_t sum = 0;
+    JsonSpan doc;
+    int res;
+    while ((res = json_ring_next(&r, &doc)) == JSON_RING_DOC) {
+        sum += parse_msg(doc.begin, doc.end);
+        json_ring_release(&r, doc);
+    }
+    if (res != JSON_RING_END)
+        abort();
+    json_ring_free(&r);
+    return sum;
+}
+
+static int64_t by_copy(void)
+{
+    static char buf[BUF_SIZE];
+    static char msg[MAX_MSG];
+    size_t n = 0;
+    int64_t sum = 0;
+    for (;;) {
+        ssize_t k = read(fd, buf + n, sizeof(buf) - n);
+        if (k < 0)
+            abort();
+        if (!k)
+            break;
+        n += k;
+        const char *p = buf;
+        const char *end = buf + n;
+        for (;;) {
+            p = json_scan_skip_ws(p, end);
+            if (p == end)
+                break;
+            JsonScanState st = json_scan_state_new();
+            const char *q = json_scan_skip_nested(&st, p, end);
+            if (!q)
+                break;
+            if ((size_t) (q - p) > sizeof(msg))
+                abort();
+            memcpy(msg, p, q - p);
+            sum += parse_msg(msg, msg + (q - p));
+            p = q;
+        }
+        n = end - p;
+        memmove(buf, p, n);
+    }
+    return sum;
+}
+
+static void run(const char *name, int64_t (*f)(void))
+{
+    int64_t r = 0;
+    double best = -1;
+    for (int k = 0; k < NROUNDS; ++k) {
+        if (lseek(fd, 0, SEEK_SET) < 0)
+            abort();
+        double t0 = now_ns();
+        r = f();
+        double t = now_ns() - t0;
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    printf("%-6s %8.1f ns per message, %6.2f GB/s (%" PRId64 ")\n", name, best / NMSGS, nbytes / best, r);
+}
+
+int main()
+{
+    gen();
+    run("ring", by_ring);
+    run("copy", by_copy);
+    return 0;
+}
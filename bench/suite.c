@@ -0,0 +1,558 @@
+// Runs every benchmark on every corpus (see 'corpus.h'), minified and pretty-printed, and prints
+// one JSON line per run:
+//
+//     {"bench":"parse_dict_fields","corpus":"orders","layout":"minified","bytes":...,"items":...,
+//      "passes":...,"ns_per_pass":...,"gb_per_s":...,"items_per_s":...,"cycles_per_byte":...}
+//
+// 'bytes' and 'items' are what a single pass processes: whole messages for the parsers, string
+// values for 'unesc' and 'esc', numbers for 'parse_num' and 'gen_*'. The time of the fastest pass
+// is reported. 'cycles_per_byte' is measured with the time stamp counter (that is, in reference
+// cycles) and is null where there is none.
+//
+// Usage: suite [--filter SUBSTRING] [--min-time MS] [--seed N]
+// where SUBSTRING is matched against "bench/corpus/layout".
+
+#include "corpus.h"
+#include "json_visit.h"
+#include "json_visit_preempt.h"
+#include "json_parse_num.h"
+#include "json_gen_num.h"
+#include "json_esc.h"
+#include "json_write.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+# define HAVE_TSC 1
+#else
+# define HAVE_TSC 0
+#endif
+
+enum { MAX_KEYS = 8 };
+
+typedef struct {
+    const Corpus *c;
+    JsonFieldEntry entries[MAX_KEYS];
+
+    // String values, with the quotes.
+    JsonSpan *strs;
+    size_t nstrs;
+    size_t nstr_bytes;
+    // The same, unescaped.
+    JsonSpan *raws;
+    char *raw_arena;
+    size_t nraw_bytes;
+    // Numbers, both unquoted and quoted ones (without the quotes), and their values at scale 8.
+    JsonSpan *nums;
+    int64_t *vals;
+    size_t nnums;
+    size_t nnum_bytes;
+    size_t ngen_bytes;
+
+    size_t max_str;
+    char *scratch;
+} Data;
+
+static volatile uint64_t sink;
+
+static void collect(Data *d, JsonSpan v, size_t *capstrs, size_t *capnums)
+{
+    switch (json_span_classify(v)) {
+    case JSON_CLASS_ARRAY:
+        {
+            JsonSpan e = {0};
+            int r;
+            while ((r = json_array_next(v, &e)) > 0) {
+                collect(d, e, capstrs, capnums);
+            }
+            if (r < 0)
+                abort();
+        }
+        break;
+    case JSON_CLASS_DICT:
+        {
+            JsonSpan k = {0};
+            JsonSpan x = {0};
+            int r;
+            while ((r = json_dict_next(v, &k, &x)) > 0) {
+                collect(d, x, capstrs, capnums);
+            }
+            if (r < 0)
+                abort();
+        }
+        break;
+    case JSON_CLASS_STR:
+        if (d->nstrs == *capstrs) {
+            d->strs = x2realloc_or_die(d->strs, capstrs, sizeof(JsonSpan));
+        }
+        d->strs[d->nstrs++] = v;
+        if (json_parse_num(v.begin + 1, v.end - 1, 8) == INT64_MIN)
+            break;
+        v = (JsonSpan) {v.begin + 1, v.end - 1};
+        // fallthrough
+    case JSON_CLASS_NUM:
+        {
+            int64_t x = json_parse_num(v.begin, v.end, 8);
+            if (x == INT64_MIN)
+                break;
+            if (d->nnums == *capnums) {
+                size_t cap = *capnums;
+                d->nums = x2realloc_or_die(d->nums, capnums, sizeof(JsonSpan));
+                d->vals = x2realloc_or_die(d->vals, &cap, sizeof(int64_t));
+            }
+            d->nums[d->nnums] = v;
+            d->vals[d->nnums] = x;
+            ++d->nnums;
+        }
+        break;
+    }
+}
+
+static void data_init(Data *d, const Corpus *c)
+{
+    *d = (Data) {.c = c};
+    assert(c->nkeys <= MAX_KEYS);
+    for (int i = 0; i < c->nkeys; ++i) {
+        d->entries[i] = (JsonFieldEntry) JSON_FENTRY(c->keys[i]);
+    }
+
+    size_t capstrs = 0;
+    size_t capnums = 0;
+    for (size_t i = 0; i < c->nmsgs; ++i) {
+        collect(d, c->msgs[i], &capstrs, &capnums);
+    }
+
+    char tmp[64];
+    for (size_t i = 0; i < d->nnums; ++i) {
+        d->nnum_bytes += d->nums[i].end - d->nums[i].begin;
+        d->ngen_bytes += json_gen_inum(tmp, d->vals[i], 8);
+    }
+
+    for (size_t i = 0; i < d->nstrs; ++i) {
+        size_t n = d->strs[i].end - d->strs[i].begin;
+        d->nstr_bytes += n;
+        if (d->max_str < n) {
+            d->max_str = n;
+        }
+    }
+    d->raws = malloc_or_die(d->nstrs ? d->nstrs : 1, sizeof(JsonSpan));
+    d->raw_arena = malloc_or_die(d->nstr_bytes + 1, sizeof(char));
+    char *out = d->raw_arena;
+    for (size_t i = 0; i < d->nstrs; ++i) {
+        ssize_t n = json_unesc(d->strs[i].begin, d->strs[i].end, out);
+        if (n < 0)
+            abort();
+        d->raws[i] = (JsonSpan) {out, out + n};
+        out += n;
+    }
+    d->nraw_bytes = out - d->raw_arena;
+
+    // Room for the escaped form of the longest string (at most twice as long), or a number.
+    d->scratch = malloc_or_die(2 * d->max_str + 64, sizeof(char));
+}
+
+static void data_free(Data *d)
+{
+    free(d->strs);
+    free(d->raws);
+    free(d->raw_arena);
+    free(d->nums);
+    free(d->vals);
+    free(d->scratch);
+}
+
+// Set inside the fiber for the 'PREEMPT_*' benchmarks.
+static PreemptDevice *preempt;
+
+static uint64_t bench_parse_dict_fields(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->c->nmsgs; ++i) {
+        JsonFieldEntry entries[MAX_KEYS];
+        memcpy(entries, d->entries, sizeof(entries));
+        JsonSpan m = d->c->msgs[i];
+        if (json_parse_dict_fields(m.begin, m.end, entries, d->c->nkeys) < 0)
+            abort();
+        r += entries[0].v_end - entries[0].v_begin;
+    }
+    return r;
+}
+
+static uint64_t bench_parse_dict_fields_exact(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->c->nmsgs; ++i) {
+        JsonFieldEntry entries[MAX_KEYS];
+        memcpy(entries, d->entries, sizeof(entries));
+        JsonSpan m = d->c->msgs[i];
+        if (json_parse_dict_fields_exact(m.begin, m.end, entries, d->c->nkeys) < 0)
+            abort();
+        r += entries[0].v_end - entries[0].v_begin;
+    }
+    return r;
+}
+
+static uint64_t bench_preempt_parse_dict_fields(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->c->nmsgs; ++i) {
+        JsonFieldEntry entries[MAX_KEYS];
+        memcpy(entries, d->entries, sizeof(entries));
+        JsonSpan m = d->c->msgs[i];
+        if (PREEMPT_json_parse_dict_fields(m.begin, m.end, entries, d->c->nkeys, preempt) < 0)
+            abort();
+        r += entries[0].v_end - entries[0].v_begin;
+    }
+    return r;
+}
+
+static uint64_t walk(JsonSpan v)
+{
+    uint64_t r = 1;
+    JsonSpan k = {0};
+    JsonSpan e = {0};
+    int rc;
+    switch (json_span_classify(v)) {
+    case JSON_CLASS_ARRAY:
+        while ((rc = json_array_next(v, &e)) > 0) {
+            r += walk(e);
+        }
+        break;
+    case JSON_CLASS_DICT:
+        while ((rc = json_dict_next(v, &k, &e)) > 0) {
+            r += walk(e);
+        }
+        break;
+    default:
+        return r;
+    }
+    if (rc < 0)
+        abort();
+    return r;
+}
+
+static uint64_t preempt_walk(JsonSpan v)
+{
+    uint64_t r = 1;
+    JsonSpan k = {0};
+    JsonSpan e = {0};
+    int rc;
+    switch (json_span_classify(v)) {
+    case JSON_CLASS_ARRAY:
+        while ((rc = PREEMPT_json_array_next(v, &e, preempt)) > 0) {
+            r += preempt_walk(e);
+        }
+        break;
+    case JSON_CLASS_DICT:
+        while ((rc = PREEMPT_json_dict_next(v, &k, &e, preempt)) > 0) {
+            r += preempt_walk(e);
+        }
+        break;
+    default:
+        return r;
+    }
+    if (rc < 0)
+        abort();
+    return r;
+}
+
+static uint64_t bench_walk(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->c->nmsgs; ++i) {
+        r += walk(d->c->msgs[i]);
+    }
+    return r;
+}
+
+static uint64_t bench_preempt_walk(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->c->nmsgs; ++i) {
+        r += preempt_walk(d->c->msgs[i]);
+    }
+    return r;
+}
+
+static uint64_t bench_unesc(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->nstrs; ++i) {
+        r += json_unesc(d->strs[i].begin, d->strs[i].end, d->scratch);
+    }
+    return r;
+}
+
+static uint64_t bench_esc(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->nstrs; ++i) {
+        r += json_esc(d->raws[i].begin, d->raws[i].end - d->raws[i].begin, d->scratch);
+    }
+    return r;
+}
+
+static uint64_t bench_parse_num(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->nnums; ++i) {
+        r += json_parse_num(d->nums[i].begin, d->nums[i].end, 8);
+    }
+    return r;
+}
+
+static uint64_t bench_gen_inum(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->nnums; ++i) {
+        r += json_gen_inum(d->scratch, d->vals[i], 8);
+    }
+    return r;
+}
+
+static uint64_t bench_gen_unum(const Data *d)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < d->nnums; ++i) {
+        int64_t x = d->vals[i];
+        r += json_gen_unum(d->scratch, x < 0 ? -(uint64_t) x : (uint64_t) x, 8);
+    }
+    return r;
+}
+
+typedef enum {
+    UNIT_MSGS,
+    UNIT_STRS,
+    UNIT_RAWS,
+    UNIT_NUMS,
+    UNIT_GEN,
+} Unit;
+
+typedef struct {
+    const char *name;
+    uint64_t (*f)(const Data *d);
+    Unit unit;
+    bool preempt;
+} Bench;
+
+static const Bench BENCHES[] = {
+    {"parse_dict_fields", bench_parse_dict_fields, UNIT_MSGS, false},
+    {"parse_dict_fields_exact", bench_parse_dict_fields_exact, UNIT_MSGS, false},
+    {"PREEMPT_parse_dict_fields", bench_preempt_parse_dict_fields, UNIT_MSGS, true},
+    {"array_dict_next", bench_walk, UNIT_MSGS, false},
+    {"PREEMPT_array_dict_next", bench_preempt_walk, UNIT_MSGS, true},
+    {"unesc", bench_unesc, UNIT_STRS, false},
+    {"esc", bench_esc, UNIT_RAWS, false},
+    {"parse_num", bench_parse_num, UNIT_NUMS, false},
+    {"gen_inum", bench_gen_inum, UNIT_GEN, false},
+    {"gen_unum", bench_gen_unum, UNIT_GEN, false},
+};
+
+typedef struct {
+    const Bench *b;
+    const Data *d;
+    bool done;
+} Job;
+
+static void job_main(FIBER_PARAM_LIST)
+{
+    Job *job = FIBER_GET_USERDATA();
+    PreemptDevice p = preempt_new(0, FIBER_GET_PARAMS());
+    preempt = &p;
+    sink += job->b->f(job->d);
+    job->done = true;
+}
+
+static Fiber fib;
+
+static void run_pass(const Bench *b, const Data *d)
+{
+    if (!b->preempt) {
+        sink += b->f(d);
+        return;
+    }
+    Job job = {.b = b, .d = d};
+    fiber_create(&fib, job_main, &job);
+    while (!job.done) {
+        fiber_kick(&fib);
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t read_tsc(void)
+{
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void write_fixed(JsonWriter *w, double x, uint8_t scale)
+{
+    for (uint8_t i = 0; i < scale; ++i) {
+        x *= 10;
+    }
+    json_write_unum(w, (uint64_t) (x + 0.5), scale);
+}
+
+static void write_knum(JsonWriter *w, const char *key, double x, uint8_t scale)
+{
+    json_write_key(w, key, strlen(key));
+    write_fixed(w, x, scale);
+}
+
+// What a single pass of 'b' on 'd' processes.
+static void pass_size(const Bench *b, const Data *d, size_t *bytes, size_t *items)
+{
+    switch (b->unit) {
+    case UNIT_MSGS:
+        *bytes = d->c->nbuf;
+        *items = d->c->nmsgs;
+        break;
+    case UNIT_STRS:
+        *bytes = d->nstr_bytes;
+        *items = d->nstrs;
+        break;
+    case UNIT_RAWS:
+        *bytes = d->nraw_bytes;
+        *items = d->nstrs;
+        break;
+    case UNIT_NUMS:
+        *bytes = d->nnum_bytes;
+        *items = d->nnums;
+        break;
+    case UNIT_GEN:
+        *bytes = d->ngen_bytes;
+        *items = d->nnums;
+        break;
+    default:
+        abort();
+    }
+}
+
+static void report(
+        const Bench *b, const Data *d, size_t bytes, size_t items,
+        size_t passes, double ns, uint64_t tsc)
+{
+    char buf[512];
+    JsonWriter w;
+    json_writer_init(&w, buf, sizeof(buf), 0);
+    json_write_obj_begin(&w);
+    json_write_key(&w, "bench", 5);
+    json_write_str(&w, b->name, strlen(b->name));
+    json_write_key(&w, "corpus", 6);
+    const char *corpus = corpus_kind_name(d->c->kind);
+    json_write_str(&w, corpus, strlen(corpus));
+    json_write_key(&w, "layout", 6);
+    json_write_str(&w, d->c->pretty ? "pretty" : "minified", d->c->pretty ? 6 : 8);
+    json_write_key(&w, "bytes", 5);
+    json_write_unum(&w, bytes, 0);
+    json_write_key(&w, "items", 5);
+    json_write_unum(&w, items, 0);
+    json_write_key(&w, "passes", 6);
+    json_write_unum(&w, passes, 0);
+    write_knum(&w, "ns_per_pass", ns, 0);
+    write_knum(&w, "gb_per_s", bytes / ns, 3);
+    write_knum(&w, "items_per_s", items / ns * 1e9, 0);
+    json_write_key(&w, "cycles_per_byte", 15);
+    if (HAVE_TSC) {
+        write_fixed(&w, (double) tsc / bytes, 3);
+    } else {
+        json_write_null(&w);
+    }
+    json_write_obj_end(&w);
+
+    JsonSpan s = json_writer_span(&w);
+    assert(s.begin != NULL);
+    fwrite(s.begin, 1, s.end - s.begin, stdout);
+    putchar('\n');
+    fflush(stdout);
+    json_writer_destroy(&w);
+}
+
+static void run_bench(const Bench *b, const Data *d, double min_time_ns)
+{
+    size_t bytes;
+    size_t items;
+    pass_size(b, d, &bytes, &items);
+    if (!items)
+        return;
+
+    // Warm up.
+    run_pass(b, d);
+
+    double best_ns = -1;
+    uint64_t best_tsc = 0;
+    size_t passes = 0;
+    double started = now_ns();
+    do {
+        double t0 = now_ns();
+        uint64_t c0 = read_tsc();
+        run_pass(b, d);
+        uint64_t c1 = read_tsc();
+        double t1 = now_ns();
+        if (best_ns < 0 || t1 - t0 < best_ns) {
+            best_ns = t1 - t0;
+            best_tsc = c1 - c0;
+        }
+        ++passes;
+    } while (now_ns() - started < min_time_ns || passes < 3);
+
+    report(b, d, bytes, items, passes, best_ns, best_tsc);
+}
+
+static void usage(void)
+{
+    fputs("USAGE: suite [--filter SUBSTRING] [--min-time MS] [--seed N]\n", stderr);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL;
+    double min_time_ns = 200e6;
+    uint64_t seed = 42;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc)
+            usage();
+        if (strcmp(argv[i], "--filter") == 0) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0) {
+            min_time_ns = atof(argv[++i]) * 1e6;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            usage();
+        }
+    }
+
+    for (int kind = 0; kind < CORPUS_NKINDS; ++kind) {
+        for (int pretty = 0; pretty < 2; ++pretty) {
+            Corpus c;
+            corpus_gen(&c, kind, pretty, seed);
+            Data d;
+            data_init(&d, &c);
+            for (size_t i = 0; i < array_size(BENCHES); ++i) {
+                const Bench *b = &BENCHES[i];
+                if (filter) {
+                    char *id = allocf_or_die(
+                        "%s/%s/%s", b->name, corpus_kind_name(kind), pretty ? "pretty" : "minified");
+                    bool match = strstr(id, filter) != NULL;
+                    free(id);
+                    if (!match)
+                        continue;
+                }
+                run_bench(b, &d, min_time_ns);
+            }
+            data_free(&d);
+            corpus_free(&c);
+        }
+    }
+    return 0;
+}
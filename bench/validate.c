@@ -0,0 +1,85 @@
+// Compares the throughput of the plain (sloppy) and the validating ('VALIDATE_*') parsers, the
+// latter with each implementation of 'json_validate', on a large message with mostly ASCII, mostly
+// non-ASCII and long non-ASCII text in the strings.
+
+#include "json_validate.h"
+#include "json_visit.h"
+#include "json_visit_validate.h"
+
+enum { NROUNDS = 50 };
+
+static char *msg;
+static size_t nmsg;
+
+static void gen_msg(const char *text)
+{
+    size_t cap = 8 * 1024 * 1024;
+    msg = realloc_or_die(msg, cap, 1);
+    size_t n = 0;
+    n += sprintf(msg + n, "{\"snapshot\": [");
+    for (int i = 0; n + 256 < cap - 64; ++i) {
+        n += sprintf(
+            msg + n,
+            "%s{\"id\": %d, \"px\": \"%d.25\", \"qty\": -%d.5e3, \"text\": \"%s\", "
+            "\"flags\": [true, false, null], \"levels\": [[1, 2], [3, 4]]}",
+            i ? ", " : "", i, i * 7, i % 100, text);
+    }
+    n += sprintf(msg + n, "], \"seq\": 12345}");
+    nmsg = n;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name)
+{
+    JsonFieldEntry entries[] = {JSON_FENTRY("snapshot"), JSON_FENTRY("seq")};
+    double t0 = now_ns();
+    for (int i = 0; i < NROUNDS; ++i) {
+        if (json_parse_dict_fields(msg, msg + nmsg, entries, 2) < 0) {
+            abort();
+        }
+    }
+    double t1 = now_ns();
+    for (int i = 0; i < NROUNDS; ++i) {
+        if (VALIDATE_json_parse_dict_fields(msg, msg + nmsg, entries, 2) < 0) {
+            abort();
+        }
+    }
+    double t2 = now_ns();
+    if (!json_validate_select(JSON_VALIDATE_IMPL_SCALAR)) {
+        abort();
+    }
+    for (int i = 0; i < NROUNDS; ++i) {
+        if (VALIDATE_json_parse_dict_fields(msg, msg + nmsg, entries, 2) < 0) {
+            abort();
+        }
+    }
+    double t3 = now_ns();
+    json_validate_select(JSON_VALIDATE_IMPL_AUTO);
+    printf("%-9s plain %6.2f GB/s, validating %6.2f GB/s (scalar %6.2f GB/s)\n",
+           name,
+           (double) nmsg * NROUNDS / (t1 - t0),
+           (double) nmsg * NROUNDS / (t2 - t1),
+           (double) nmsg * NROUNDS / (t3 - t2));
+}
+
+int main()
+{
+    gen_msg("lorem \\\"ipsum\\\" dolor sit amet, consectetur adipiscing elit");
+    run("ascii");
+    gen_msg("\xd0\xbb\xd0\xbe\xd1\x80\xd0\xb5\xd0\xbc \xd0\xb8\xd0\xbf\xd1\x81\xd1\x83\xd0\xbc "
+            "\xe2\x82\xac \xf0\x9f\x98\x80 dolor sit amet");
+    run("non-ascii");
+    gen_msg("\xd0\xbb\xd0\xbe\xd1\x80\xd0\xb5\xd0\xbc \xd0\xb8\xd0\xbf\xd1\x81\xd1\x83\xd0\xbc "
+            "\xd0\xb4\xd0\xbe\xd0\xbb\xd0\xbe\xd1\x80 \xd1\x81\xd0\xb8\xd1\x82 \xd0\xb0\xd0\xbc\xd0\xb5\xd1\x82, "
+            "\xd0\xba\xd0\xbe\xd0\xbd\xd1\x81\xd0\xb5\xd0\xba\xd1\x82\xd0\xb5\xd1\x82\xd1\x83\xd1\x80 "
+            "\xd0\xb0\xd0\xb4\xd0\xb8\xd0\xbf\xd0\xb8\xd1\x81\xd1\x86\xd0\xb8\xd0\xbd\xd0\xb3 "
+            "\xd1\x8d\xd0\xbb\xd0\xb8\xd1\x82 \xe2\x82\xac \xf0\x9f\x98\x80");
+    run("long-text");
+    return 0;
+}
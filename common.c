@@ -92,3 +92,36 @@ char *allocf_or_die(const char *fmt, ...)
     va_end(vl);
     return r;
 }
+
+static double ticks_per_ns_value;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void calibrate_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    enum { CALIBRATION_NS = 2000000 };
+    uint64_t t0 = monotonic_ns();
+    uint64_t c0 = ticks_now();
+    uint64_t t1;
+    do {
+        t1 = monotonic_ns();
+    } while (t1 - t0 < CALIBRATION_NS);
+    uint64_t c1 = ticks_now();
+    ticks_per_ns_value = (double) (c1 - c0) / (t1 - t0);
+#else
+    ticks_per_ns_value = 1.0;
+#endif
+}
+
+double ticks_per_ns(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, calibrate_ticks);
+    return ticks_per_ns_value;
+}
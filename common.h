@@ -16,6 +16,10 @@
 #include <errno.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
 #define in_header       static inline __attribute__((unused))
 #define likely(E)       __builtin_expect((E), 1)
 #define unlikely(E)     __builtin_expect((E), 0)
@@ -45,3 +49,20 @@ char *allocvf_or_die(const char *fmt, va_list vl);
 
 __attribute__((format(printf, 1, 2)))
 char *allocf_or_die(const char *fmt, ...);
+
+// A cheap monotonic clock: the time stamp counter where there is one (assumed to be invariant, as
+// on any recent x86 CPU), 'CLOCK_MONOTONIC' in nanoseconds otherwise.
+in_header uint64_t ticks_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Returns the number of 'ticks_now()' ticks per nanosecond. The first call calibrates it against
+// 'CLOCK_MONOTONIC', which takes a couple of milliseconds.
+double ticks_per_ns(void);
@@ -0,0 +1,85 @@
+#include "fiber.h"
+
+#if FIBER_ASM
+
+// void fiber_asm_switch(void **save_sp, void *new_sp)
+//
+// The frame pushed onto the stack being left (and popped from the one being entered) consists of
+// the callee-saved registers of the platform's C ABI and the return address; 'fiber_create()'
+// builds the initial frame of a fiber in the same layout.
+//
+// Note that the first argument register is left intact, so that the first switch into a fiber
+// "returns" into 'fiber_asm_start()' with 'save_sp' as its argument.
+
+# if defined(__x86_64__)
+
+__asm__(
+    ".text\n"
+    ".globl fiber_asm_switch\n"
+    ".type fiber_asm_switch, @function\n"
+    ".p2align 4\n"
+    "fiber_asm_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $16, %rsp\n"
+    "    fnstcw (%rsp)\n"
+    "    stmxcsr 8(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    fldcw (%rsp)\n"
+    "    ldmxcsr 8(%rsp)\n"
+    "    addq $16, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size fiber_asm_switch, .-fiber_asm_switch\n"
+);
+
+# elif defined(__aarch64__)
+
+__asm__(
+    ".text\n"
+    ".globl fiber_asm_switch\n"
+    ".type fiber_asm_switch, %function\n"
+    ".p2align 4\n"
+    "fiber_asm_switch:\n"
+    "    sub sp, sp, #160\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x2, sp\n"
+    "    str x2, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #160\n"
+    "    ret\n"
+    ".size fiber_asm_switch, .-fiber_asm_switch\n"
+);
+
+# endif
+
+#endif
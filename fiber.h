@@ -1,7 +1,6 @@
 #pragma once
 
 #include "common.h"
-#include <ucontext.h>
 
 // A fiber is a cooperative multitasking process.
 //
@@ -14,6 +13,20 @@
 // returned from its main function). Therefore, you need to check the state
 // of the fiber via some third-party mechanism after you call 'fiber_kick()'
 // to maintain an up-to-date information on whether or not it is dead.
+//
+// There are two backends behind the same API:
+//   * the "asm" one (x86-64 and aarch64 ELF targets), which switches stacks with a small
+//     hand-written routine that saves and restores only the callee-saved registers;
+//   * the "ucontext" one, based on 'swapcontext()'. On glibc, it saves and restores the signal
+//     mask, which costs a system call per switch.
+// The asm backend is used where available, unless FIBER_USE_UCONTEXT is defined.
+
+#if !defined(FIBER_USE_UCONTEXT) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+# define FIBER_ASM 1
+#else
+# define FIBER_ASM 0
+# include <ucontext.h>
+#endif
 
 #ifndef FIBER_STACKSZ
 # define FIBER_STACKSZ (4 * 1024 * 1024)
@@ -70,6 +83,90 @@ void fiber_handle_error(const char *expr)
     ((int) (uintptr_t) (P_)), \
     ((int) (((uintptr_t) (P_)) >> 31 >> 1))
 
+#if FIBER_ASM
+
+typedef struct {
+    // The saved stack pointer; the callee-saved registers are stored on the stack itself.
+    void *sp;
+} FiberCtx;
+
+typedef struct {
+    FiberCtx *ctx_pair;
+} FiberParams;
+
+typedef struct {
+    // 'ctx_pair[0]' is the fiber's context, 'ctx_pair[1]' is the context of the kicker.
+    // These go before the stack so that 'fiber_asm_start()' sees the same layout whatever
+    // FIBER_STACKSZ is.
+    FiberCtx ctx_pair[2];
+    void (*f)(FIBER_PARAM_LIST);
+    void *f_arg;
+    char stack[FIBER_STACKSZ];
+} Fiber;
+
+// Saves the callee-saved registers on the current stack, stores the stack pointer into
+// '*save_sp', switches to the stack 'new_sp' and restores the registers saved there.
+// Defined in 'fiber.c'.
+void fiber_asm_switch(void **save_sp, void *new_sp);
+
+// The first switch into a fiber "returns" here; 'fiber_asm_switch()' does not touch its first
+// argument register, so 'kicker_sp' is '&fib->ctx_pair[1].sp'.
+static __attribute__((unused, noreturn))
+void fiber_asm_start(void **kicker_sp)
+{
+    Fiber *fib = (Fiber *) ((char *) kicker_sp - offsetof(Fiber, ctx_pair[1].sp));
+    fib->f(FIBER_PACK_P_INTO_II(fib->f_arg), FIBER_PACK_P_INTO_II(fib->ctx_pair));
+    // The main function has returned; go back to the kicker for good.
+    void *dummy;
+    fiber_asm_switch(&dummy, fib->ctx_pair[1].sp);
+    __builtin_unreachable();
+}
+
+in_header void fiber_create(Fiber *fib, void (*f)(FIBER_PARAM_LIST), void *f_arg)
+{
+    fib->f = f;
+    fib->f_arg = f_arg;
+
+    // Lay out the frame that 'fiber_asm_switch()' expects to find, with all the registers zero
+    // except for the return address, which points to 'fiber_asm_start()'.
+    uintptr_t top = ((uintptr_t) (fib->stack + FIBER_STACKSZ)) & ~(uintptr_t) 15;
+    void **sp = (void **) top;
+# if defined(__x86_64__)
+    // Padding, so that 'fiber_asm_start()' is entered with the stack aligned as if it had been
+    // called: (rsp + 8) % 16 == 0.
+    *--sp = NULL;
+    // Return address; then rbp, rbx, r12, r13, r14, r15.
+    *--sp = (void *) fiber_asm_start;
+    for (int i = 0; i < 6; ++i) {
+        *--sp = NULL;
+    }
+    // x87 control word at 0(rsp) and MXCSR at 8(rsp), both set to their default values.
+    sp -= 2;
+    memset(sp, 0, 16);
+    *(uint16_t *) sp = 0x037F;
+    *(uint32_t *) (sp + 1) = 0x1F80;
+# else
+    // x19...x28, x29 (frame pointer), x30 (link register), then d8...d15.
+    sp -= 20;
+    memset(sp, 0, 20 * sizeof(void *));
+    sp[11] = (void *) fiber_asm_start;
+# endif
+    fib->ctx_pair[0].sp = sp;
+    fib->ctx_pair[1].sp = NULL;
+}
+
+in_header void fiber_kick(Fiber *fib)
+{
+    fiber_asm_switch(&fib->ctx_pair[1].sp, fib->ctx_pair[0].sp);
+}
+
+in_header void fiber_yield(FiberParams *fib_par)
+{
+    fiber_asm_switch(&fib_par->ctx_pair[0].sp, fib_par->ctx_pair[1].sp);
+}
+
+#else
+
 typedef struct {
     ucontext_t *ctx_pair;
 } FiberParams;
@@ -101,3 +198,5 @@ in_header void fiber_yield(FiberParams *fib_par)
 {
     FIBER_CHECK(swapcontext(&fib_par->ctx_pair[0], &fib_par->ctx_pair[1]));
 }
+
+#endif
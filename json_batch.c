@@ -0,0 +1,215 @@
+#include "json_batch.h"
+#include "json_visit.h"
+#include "json_parse_num.h"
+
+// The fields are compiled into a tree of dicts: each node lists the keys wanted from a dict, and
+// each key may have fields ending at it and/or a child node for the keys wanted from its value.
+typedef struct {
+    JsonFieldEntry *tmpl;
+    // For each key: the index of the child node, or -1.
+    int *child;
+    // For each key: the index of the first field ending at it, or -1; see 'Plan.field_next'.
+    int *field_head;
+    int n;
+    size_t cap;
+} PlanNode;
+
+typedef struct {
+    PlanNode *nodes;
+    int nnodes;
+    size_t capnodes;
+    // For each field: the index of the next field ending at the same key, or -1.
+    int *field_next;
+} Plan;
+
+typedef struct {
+    const Plan *plan;
+    const JsonSpan *docs;
+    const JsonBatchField *fields;
+    int nfields;
+    int *status;
+    unsigned flags;
+    // Per-worker counts of failed documents.
+    size_t *nfailed;
+} BatchArg;
+
+static int plan_add_node(Plan *p)
+{
+    if ((size_t) p->nnodes == p->capnodes) {
+        p->nodes = x2realloc_or_die(p->nodes, &p->capnodes, sizeof(PlanNode));
+    }
+    p->nodes[p->nnodes] = (PlanNode) {0};
+    return p->nnodes++;
+}
+
+static int plan_find_or_add_key(Plan *p, int node, const char *key)
+{
+    PlanNode *nd = &p->nodes[node];
+    size_t nkey = strlen(key);
+    for (int i = 0; i < nd->n; ++i) {
+        if (nd->tmpl[i].nkey == nkey && memcmp(nd->tmpl[i].key, key, nkey) == 0)
+            return i;
+    }
+    if ((size_t) nd->n == nd->cap) {
+        size_t cap = nd->cap;
+        nd->tmpl = x2realloc_or_die(nd->tmpl, &cap, sizeof(JsonFieldEntry));
+        nd->child = realloc_or_die(nd->child, cap, sizeof(int));
+        nd->field_head = realloc_or_die(nd->field_head, cap, sizeof(int));
+        nd->cap = cap;
+    }
+    int i = nd->n++;
+    nd->tmpl[i] = (JsonFieldEntry) JSON_FENTRY(key);
+    nd->child[i] = -1;
+    nd->field_head[i] = -1;
+    return i;
+}
+
+static void plan_build(Plan *p, const JsonBatchField *fields, int nfields)
+{
+    *p = (Plan) {0};
+    p->field_next = malloc_or_die(nfields, sizeof(int));
+    plan_add_node(p);
+
+    for (int f = 0; f < nfields; ++f) {
+        assert(fields[f].npath > 0);
+        int node = 0;
+        for (int d = 0; ; ++d) {
+            int i = plan_find_or_add_key(p, node, fields[f].path[d]);
+            if (d == fields[f].npath - 1) {
+                p->field_next[f] = p->nodes[node].field_head[i];
+                p->nodes[node].field_head[i] = f;
+                break;
+            }
+            if (p->nodes[node].child[i] < 0) {
+                int c = plan_add_node(p);
+                p->nodes[node].child[i] = c;
+            }
+            node = p->nodes[node].child[i];
+        }
+    }
+}
+
+static void plan_free(Plan *p)
+{
+    for (int i = 0; i < p->nnodes; ++i) {
+        free(p->nodes[i].tmpl);
+        free(p->nodes[i].child);
+        free(p->nodes[i].field_head);
+    }
+    free(p->nodes);
+    free(p->field_next);
+}
+
+// Parses a number, possibly quoted.
+static inline int64_t parse_num(JsonSpan v, uint8_t scale)
+{
+    if (v.end - v.begin >= 2 && v.begin[0] == '"') {
+        ++v.begin;
+        --v.end;
+    }
+    return json_parse_num(v.begin, v.end, scale);
+}
+
+// Returns false on a parse error.
+static bool visit(const BatchArg *a, int node, JsonSpan d, size_t doc)
+{
+    const PlanNode *nd = &a->plan->nodes[node];
+    JsonFieldEntry entries[nd->n];
+    memcpy(entries, nd->tmpl, nd->n * sizeof(JsonFieldEntry));
+
+    int r;
+    if (a->flags & JSON_BATCH_EXACT) {
+        r = json_parse_dict_fields_exact(d.begin, d.end, entries, nd->n);
+    } else {
+        r = json_parse_dict_fields(d.begin, d.end, entries, nd->n);
+    }
+    bool ok = r >= 0;
+
+    for (int i = 0; i < nd->n; ++i) {
+        JsonSpan v = json_span_from_fentry(entries[i]);
+        if (!v.begin)
+            continue;
+        for (int f = nd->field_head[i]; f >= 0; f = a->plan->field_next[f]) {
+            const JsonBatchField *fld = &a->fields[f];
+            fld->spans[doc] = v;
+            if (fld->nums) {
+                fld->nums[doc] = parse_num(v, fld->scale);
+            }
+        }
+        int c = nd->child[i];
+        // A value on the path that is not a dict (e.g. null) just means the fields are absent.
+        if (c >= 0 && json_classify(v.begin, v.end) == JSON_CLASS_DICT) {
+            ok &= visit(a, c, v, doc);
+        }
+    }
+    return ok;
+}
+
+static void batch_chunk(void *arg, size_t begin, size_t end, int worker)
+{
+    const BatchArg *a = arg;
+
+    for (int f = 0; f < a->nfields; ++f) {
+        const JsonBatchField *fld = &a->fields[f];
+        for (size_t i = begin; i < end; ++i) {
+            fld->spans[i] = (JsonSpan) {NULL, NULL};
+        }
+        if (fld->nums) {
+            for (size_t i = begin; i < end; ++i) {
+                fld->nums[i] = INT64_MIN;
+            }
+        }
+    }
+
+    size_t nfailed = 0;
+    for (size_t i = begin; i < end; ++i) {
+        bool ok = visit(a, 0, a->docs[i], i);
+        if (a->status) {
+            a->status[i] = ok ? 0 : -1;
+        }
+        nfailed += !ok;
+    }
+    a->nfailed[worker] += nfailed;
+}
+
+size_t json_batch_parse(
+        WorkPool *wp,
+        const JsonSpan *docs,
+        size_t ndocs,
+        const JsonBatchField *fields,
+        int nfields,
+        int *status,
+        unsigned flags)
+{
+    // Also keeps the per-dict entry arrays in 'visit()' from being empty.
+    assert(nfields > 0);
+
+    Plan plan;
+    plan_build(&plan, fields, nfields);
+
+    int nworkers = workpool_nworkers(wp);
+    size_t *nfailed = calloc_or_die(nworkers, sizeof(size_t));
+
+    BatchArg a = {
+        .plan    = &plan,
+        .docs    = docs,
+        .fields  = fields,
+        .nfields = nfields,
+        .status  = status,
+        .flags   = flags,
+        .nfailed = nfailed,
+    };
+    // Documents are usually small, so take them in chunks big enough to amortize the stealing.
+    size_t chunk = ndocs / (64 * (size_t) nworkers);
+    if (chunk < 16)
+        chunk = 16;
+    workpool_run(wp, ndocs, chunk, batch_chunk, &a);
+
+    size_t total = 0;
+    for (int i = 0; i < nworkers; ++i) {
+        total += nfailed[i];
+    }
+    free(nfailed);
+    plan_free(&plan);
+    return total;
+}
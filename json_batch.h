@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+#include "workpool.h"
+
+// Extraction of the same set of fields from many documents at once, spread over a 'WorkPool'.
+//
+// The results are written into caller-provided column arrays (one element per document), so that
+// no per-document allocation is needed and each worker writes to its own parts of the columns.
+
+typedef struct {
+    // The keys leading from the document (a dict) to the field, e.g. {"data", "px"} for
+    // '{"data": {"px": ...}}'. Keys are matched like in 'json_parse_dict_fields()'.
+    const char *const *path;
+    int npath;
+    // Receives the span of the field's value in each document; {NULL, NULL} if the field is
+    // absent.
+    JsonSpan *spans;
+    // If not NULL, receives the value parsed with 'json_parse_num(..., scale)' in each document
+    // (a quoted number, as in '"1.25"', is unquoted first); INT64_MIN if the field is absent or
+    // is not a number.
+    int64_t *nums;
+    uint8_t scale;
+} JsonBatchField;
+
+enum {
+    // Match keys with 'json_parse_dict_fields_exact()' (handling escapes).
+    JSON_BATCH_EXACT = 1 << 0,
+};
+
+// Extracts 'fields' ('nfields' > 0) from each of the 'ndocs' documents. If 'status' is not NULL,
+// 'status[i]' is set to 0 if document 'i' was parsed successfully and to -1 otherwise (fields
+// found before the error are still filled in). Returns the number of documents that failed.
+size_t json_batch_parse(
+        WorkPool *wp,
+        const JsonSpan *docs,
+        size_t ndocs,
+        const JsonBatchField *fields,
+        int nfields,
+        int *status,
+        unsigned flags);
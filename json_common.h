@@ -26,6 +26,28 @@ typedef struct {
 
 #define JSON_FENTRY(K) {(K), strlen(K), NULL, NULL}
 
+enum {
+    // Stop as soon as every entry has been found. The first occurrence of a key then wins, and
+    // the rest of the dict is neither scanned nor checked for errors.
+    JSON_KD_EARLY_EXIT = 1 << 0,
+};
+
+// Key dispatch for the 'json_parse_dict_fields_kd*' functions; normally generated by the DSL.
+//
+// If 'table' is NULL, the entries are scanned linearly. Otherwise, a key {k ... k+nk} can only
+// match entry number 'table[h]' (0xFF means none), provided that min_len <= nk <= max_len, where
+//     h = ((nk | k[pos[0]] << 8 | k[pos[1]] << 16) * mult) >> shift
+// in 32-bit unsigned arithmetic, and negative positions count from the end of the key.
+typedef struct {
+    uint8_t flags;
+    uint8_t min_len;
+    uint8_t max_len;
+    uint8_t shift;
+    int8_t pos[2];
+    uint32_t mult;
+    const uint8_t *table;
+} JsonKeyDispatch;
+
 typedef struct {
     const char *v_begin;
     const char *v_end;
@@ -37,6 +59,72 @@ typedef struct {
     const char *v_end;
 } JsonSparseElemEntry;
 
+enum {
+    JSON_PLAN_DICT,
+    JSON_PLAN_DICT_EXACT,
+    JSON_PLAN_ARRAY,
+    JSON_PLAN_ARRAY_SPARSE,
+};
+
+// A node of an extraction plan for 'json_parse_plan()'; normally generated by the DSL.
+//
+// A node describes what is wanted from a dict or an array: its entries are those that
+// 'json_parse_dict_fields()' (or '_exact', or '_kd', with 'kd' not NULL), 'json_parse_array_elems()'
+// or 'json_parse_array_elems_sparse()' would take, according to 'kind'. If 'sub' is not NULL,
+// 'sub[i]' is either NULL or the node for the value of entry 'i', which is then parsed as it is met
+// instead of being skipped over.
+typedef struct JsonPlan {
+    uint8_t kind;
+    int nentries;
+    union {
+        JsonFieldEntry *fields;
+        JsonElemEntry *elems;
+        JsonSparseElemEntry *sparse_elems;
+    };
+    const JsonKeyDispatch *kd;
+    const struct JsonPlan *const *sub;
+} JsonPlan;
+
+enum {
+    // An 'int64_t' scaled by 10^scale (as per 'json_parse_num()'), from a number or a string
+    // containing one.
+    JSON_RECORD_INT,
+    // A 'bool', from 'true' or 'false'.
+    JSON_RECORD_BOOL,
+    // A NUL-terminated 'char[size]', from a string (unescaped) or any other scalar (verbatim).
+    JSON_RECORD_STR,
+    // A 'char', the first character of a string (or of any other scalar); '\0' for "".
+    JSON_RECORD_CHAR,
+    // The fields of the nested dict 'rec', stored relative to 'offset'.
+    JSON_RECORD_DICT,
+    // An array of dicts decoded with 'rec' into the array of 'size' records at 'offset', the number
+    // of them being stored as an 'uint32_t' at 'count_offset'; elements past 'size' are ignored.
+    JSON_RECORD_LIST,
+};
+
+struct JsonRecord;
+
+// A field of a record for 'json_decode_record()'; normally generated by the DSL.
+typedef struct {
+    uint8_t type;
+    uint8_t scale;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t count_offset;
+    const struct JsonRecord *rec;
+} JsonRecordField;
+
+// A record: the dict keys to be matched (only 'key' and 'nkey' of the entries are used) and the
+// fields their values are decoded into, optionally with a key dispatch (without an early exit);
+// 'size' is the size of the C struct.
+typedef struct JsonRecord {
+    int nfields;
+    const JsonFieldEntry *keys;
+    const JsonRecordField *fields;
+    const JsonKeyDispatch *kd;
+    size_t size;
+} JsonRecord;
+
 in_header int json_parse_bool(const char *buf, const char *buf_end)
 {
     size_t n = buf_end - buf;
@@ -83,3 +171,77 @@ in_header bool json_span_empty(JsonSpan x)
 {
     return x.begin == x.end;
 }
+
+// An entry of a structural index ("tape"); see 'json_tape_build()'.
+// Offsets are relative to the beginning of the indexed buffer.
+typedef struct {
+    // The span of the value (or, for dict keys, of the key, including quotes).
+    uint32_t begin;
+    uint32_t end;
+    // The index of the next sibling entry (for dict keys and values, of the next key), or 0 if
+    // this is the last one.
+    uint32_t next;
+} JsonTapeEntry;
+
+typedef struct {
+    const char *base;
+    JsonTapeEntry *entries;
+    size_t nentries;
+    // The index of the most recently visited entry; used to locate spans in O(1) while iterating.
+    size_t hint;
+} JsonTape;
+
+in_header JsonSpan json_tape_span(const JsonTape *t, size_t i)
+{
+    JsonTapeEntry e = t->entries[i];
+    return (JsonSpan) {t->base + e.begin, t->base + e.end};
+}
+
+// A position within an array or dict for 'JsonCursor': the span of an element (for a dict, of the
+// key, including quotes, and of the value; 'k' is unused for arrays).
+typedef struct {
+    JsonSpan k;
+    JsonSpan v;
+} JsonCursorMark;
+
+enum {
+    JSON_CURSOR_DEFAULT_NMARKS = 64,
+    JSON_CURSOR_DEFAULT_EVERY = 8,
+};
+
+// A cursor over an array or a dict 'c' for repeated random access by the 'json_cursor_*'
+// functions: it remembers the last element visited and, for every 'every'-th element visited, a
+// "mark" in 'marks' (an array of size 'capmarks'), and resumes scanning from whichever of them is
+// the nearest before the element wanted. Once 'marks' is full, every other mark is dropped and
+// 'every' is doubled, so that the marks keep covering the whole container.
+typedef struct {
+    JsonSpan c;
+    JsonCursorMark last;
+    // The index of the element after 'last'; 0 if there is no 'last'.
+    size_t next;
+    JsonCursorMark *marks;
+    size_t nmarks;
+    size_t capmarks;
+    size_t every;
+    // The number of elements, once the end has been reached; SIZE_MAX before that.
+    size_t count;
+} JsonCursor;
+
+in_header JsonCursor json_cursor_new(JsonSpan c, JsonCursorMark *marks, size_t capmarks, size_t every)
+{
+    assert(every > 0);
+    return (JsonCursor) {
+        .c = c,
+        .marks = marks,
+        .capmarks = capmarks,
+        .every = every,
+        .count = SIZE_MAX,
+    };
+}
+
+// Moves the cursor back to before the first element; the marks are kept.
+in_header void json_cursor_rewind(JsonCursor *cur)
+{
+    cur->last = (JsonCursorMark) {0};
+    cur->next = 0;
+}
@@ -1,5 +1,9 @@
 #include "json_esc.h"
 
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 static const char table[256] = {
     ['"']  = '"',
     ['\\'] = '\\',
@@ -11,20 +15,82 @@ static const char table[256] = {
     ['\t'] = 't',
 };
 
+// Whether the byte might need escaping: it is either in 'table' or a control byte (< 0x20).
+static inline bool is_special(char c)
+{
+    return ((unsigned char) c) < 0x20 || table[(unsigned char) c];
+}
+
+#if defined(__SSE2__)
+
+static inline uint32_t special_mask16(__m128i x)
+{
+    // x <= 0x1F (unsigned)
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1F)), x);
+    __m128i quote = _mm_cmpeq_epi8(x, _mm_set1_epi8('"'));
+    __m128i bslash = _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'));
+    __m128i slash = _mm_cmpeq_epi8(x, _mm_set1_epi8('/'));
+    __m128i m = _mm_or_si128(_mm_or_si128(ctl, quote), _mm_or_si128(bslash, slash));
+    return _mm_movemask_epi8(m);
+}
+
+#endif
+
+// Returns the pointer to the first special (see 'is_special()') byte in {p ... end}, or 'end'.
+static inline const char *find_special(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    for (; end - p >= 32; p += 32) {
+        uint32_t m_lo = special_mask16(_mm_loadu_si128((const __m128i *) p));
+        uint32_t m_hi = special_mask16(_mm_loadu_si128((const __m128i *) (p + 16)));
+        uint32_t m = m_lo | (m_hi << 16);
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+    }
+    if (end - p >= 16) {
+        uint32_t m = special_mask16(_mm_loadu_si128((const __m128i *) p));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+        p += 16;
+    }
+#endif
+    for (; p != end; ++p) {
+        if (is_special(*p)) {
+            break;
+        }
+    }
+    return p;
+}
+
 size_t json_esc_nextra(const char *s, size_t ns)
 {
+    const char *end = s + ns;
     size_t r = 0;
-    for (size_t i = 0; i < ns; ++i) {
-        r += (table[(unsigned char) s[i]] != 0);
+    for (;;) {
+        s = find_special(s, end);
+        if (s == end) {
+            break;
+        }
+        r += (table[(unsigned char) *s] != 0);
+        ++s;
     }
     return r;
 }
 
 size_t json_esc(const char *s, size_t ns, char *out)
 {
+    const char *end = s + ns;
     char *out_end = out;
-    for (size_t i = 0; i < ns; ++i) {
-        char c = s[i];
+    for (;;) {
+        const char *q = find_special(s, end);
+        memcpy(out_end, s, q - s);
+        out_end += q - s;
+        if (q == end) {
+            break;
+        }
+        char c = *q;
         char esc = table[(unsigned char) c];
         if (esc == '\0') {
             *out_end++ = c;
@@ -32,6 +98,46 @@ size_t json_esc(const char *s, size_t ns, char *out)
             *out_end++ = '\\';
             *out_end++ = esc;
         }
+        s = q + 1;
     }
     return out_end - out;
 }
+
+size_t json_esc_bounded(const char *s, size_t ns, char *out, size_t nout)
+{
+    static const char HEX[] = "0123456789abcdef";
+
+    const char *end = s + ns;
+    size_t n = 0;
+    for (;;) {
+        const char *q = find_special(s, end);
+        size_t nrun = q - s;
+        if (n + nrun <= nout) {
+            memcpy(out + n, s, nrun);
+        }
+        n += nrun;
+        if (q == end) {
+            break;
+        }
+
+        char c = *q;
+        char esc = table[(unsigned char) c];
+        if (esc) {
+            if (n + 2 <= nout) {
+                out[n] = '\\';
+                out[n + 1] = esc;
+            }
+            n += 2;
+        } else {
+            // A control byte without a short form.
+            if (n + 6 <= nout) {
+                memcpy(out + n, "\\u00", 4);
+                out[n + 4] = HEX[((unsigned char) c) >> 4];
+                out[n + 5] = HEX[c & 15];
+            }
+            n += 6;
+        }
+        s = q + 1;
+    }
+    return n;
+}
@@ -8,3 +8,9 @@ size_t json_esc_nextra(const char *s, size_t ns);
 
 // Writes JSON-escaped {s ... s+ns} to 'out', returning the number of bytes written.
 size_t json_esc(const char *s, size_t ns, char *out);
+
+// Writes JSON-escaped {s ... s+ns} to {out ... out+nout}. Unlike 'json_esc()', escapes all the
+// control bytes (< 0x20), those without a short form as '\u00XX'.
+// Returns the length of the escaped string. If it is greater than 'nout', the output is
+// incomplete; call again with a buffer of (at least) the returned size.
+size_t json_esc_bounded(const char *s, size_t ns, char *out, size_t nout);
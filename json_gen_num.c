@@ -1,97 +1,84 @@
 #include "json_gen_num.h"
 #include <stddef.h>
+#include <string.h>
 
+static const uint64_t POW10[20] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+static const char DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Returns the number of decimal digits in 'x'; 1 for 0.
 static inline size_t getndigits(uint64_t x)
 {
-#if 0
-    if (x < 10) return 1;
-    if (x < 100) return 2;
-    if (x < 1000) return 3;
-    if (x < 10000) return 4;
-    if (x < 100000) return 5;
-    if (x < 1000000) return 6;
-    if (x < 10000000) return 7;
-    if (x < 100000000) return 8;
-    if (x < 1000000000) return 9;
-    if (x < 10000000000) return 10;
-    if (x < 100000000000) return 11;
-    if (x < 1000000000000) return 12;
-    if (x < 10000000000000) return 13;
-    if (x < 100000000000000) return 14;
-    if (x < 1000000000000000) return 15;
-    if (x < 10000000000000000) return 16;
-    if (x < 100000000000000000) return 17;
-    if (x < 1000000000000000000) return 18;
-    if (x < 10000000000000000000u) return 19;
-    return 20;
-#else
-    size_t result = 0;
-    for (;;) {
-        if (x < 10) return result + 1;
-        if (x < 100) return result + 2;
-        if (x < 1000) return result + 3;
-        if (x < 10000) return result + 4;
-        x /= 10000;
-        result += 4;
-    }
-#endif
+    // 'x | 1' has as many digits as 'x' (powers of 10 are even), except for 0, which needs one.
+    x |= 1;
+    // floor(log10(2^nbits)) is either the number of digits or one less; 1233/4096 ~ log10(2).
+    size_t nbits = 64 - __builtin_clzll(x);
+    size_t t = (nbits * 1233) >> 12;
+    return t + (x >= POW10[t]);
 }
 
-static int gen0(char *out, uint8_t scale)
+// Writes exactly 'n' least significant decimal digits of '*x' so that they end at 'end', dividing
+// '*x' by 10^n. Returns the pointer to the first digit written.
+static inline char *write_digits(char *end, uint64_t *x, size_t n)
 {
-    if (scale) {
-        out[0] = '0';
-        out[1] = '.';
-        size_t s = scale;
-        for (size_t i = 0; i < s; ++i) {
-            // Prevent gcc from emitting 'rep stos': rep stos/movs has significant startup overhead.
-            asm volatile ("" ::: "memory");
-
-            out[2 + i] = '0';
-        }
-        return s + 2;
-    } else {
-        *out = '0';
-        return 1;
+    uint64_t y = *x;
+    for (; n >= 2; n -= 2) {
+        end -= 2;
+        memcpy(end, DIGIT_PAIRS + 2 * (y % 100), 2);
+        y /= 100;
     }
+    if (n) {
+        *--end = '0' + (y % 10);
+        y /= 10;
+    }
+    *x = y;
+    return end;
 }
 
 int json_gen_unum(char *out, uint64_t x, uint8_t scale)
 {
-    if (x == 0) {
-        return gen0(out, scale);
-    }
-
-    // Calculate the number of characters to be written without '.': max(getndigits(x), scale+1).
-    size_t r = getndigits(x);
-    if (r <= scale)
-        r = scale + 1;
+    // The integer part has at least one digit.
+    size_t ndigits = getndigits(x);
+    size_t nint = ndigits > scale ? ndigits - scale : 1;
+    size_t r = nint + (scale ? scale + 1 : 0);
 
-    char *end;
+    char *end = out + r;
     if (scale) {
-        // We're going to write '.', so increment 'r' by one.
-        ++r;
-        end = out + r;
-        char *boundary = end - scale;
-        do {
-            --end;
-            *end = '0' + (x % 10);
-            x /= 10;
-        } while (end != boundary);
-        --end;
-        *end = '.';
-    } else {
-        end = out + r;
-    }
-
-    char *boundary = out + 1;
-    while (end != boundary) {
-        --end;
-        *end = '0' + (x % 10);
-        x /= 10;
+        end = write_digits(end, &x, scale);
+        *--end = '.';
     }
-    *out = '0' + x;
-
+    write_digits(end, &x, nint);
     return r;
 }
 
@@ -106,3 +93,27 @@ int json_gen_inum(char *out, int64_t x, uint8_t scale)
     }
     return offset + json_gen_unum(out, y, scale);
 }
+
+size_t json_gen_unum_batch(char *out, const uint64_t *xs, size_t n, uint8_t scale, char sep)
+{
+    char *p = out;
+    for (size_t i = 0; i < n; ++i) {
+        if (i) {
+            *p++ = sep;
+        }
+        p += json_gen_unum(p, xs[i], scale);
+    }
+    return p - out;
+}
+
+size_t json_gen_inum_batch(char *out, const int64_t *xs, size_t n, uint8_t scale, char sep)
+{
+    char *p = out;
+    for (size_t i = 0; i < n; ++i) {
+        if (i) {
+            *p++ = sep;
+        }
+        p += json_gen_inum(p, xs[i], scale);
+    }
+    return p - out;
+}
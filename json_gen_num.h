@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Writes at most (max(scale, 20) + 2) bytes to out.
@@ -7,3 +8,11 @@ int json_gen_unum(char *out, uint64_t x, uint8_t scale);
 
 // Writes at most (max(scale, 20) + 3) bytes to out.
 int json_gen_inum(char *out, int64_t x, uint8_t scale);
+
+// Writes 'n' numbers as per 'json_gen_unum()', separated by 'sep', returning the number of bytes
+// written; that is at most n * (max(scale, 20) + 3) bytes.
+size_t json_gen_unum_batch(char *out, const uint64_t *xs, size_t n, uint8_t scale, char sep);
+
+// Writes 'n' numbers as per 'json_gen_inum()', separated by 'sep', returning the number of bytes
+// written; that is at most n * (max(scale, 20) + 4) bytes.
+size_t json_gen_inum_batch(char *out, const int64_t *xs, size_t n, uint8_t scale, char sep);
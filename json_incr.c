@@ -0,0 +1,231 @@
+#include "json_incr.h"
+
+enum {
+    // Expecting the opening bracket.
+    PHASE_OPEN,
+    // After the opening bracket; expecting either the first element or the closing bracket.
+    PHASE_FIRST,
+    // After an element; expecting either ',' or the closing bracket.
+    PHASE_SEP,
+    // Expecting a key.
+    PHASE_KEY,
+    // Inside of a key.
+    PHASE_IN_KEY,
+    // After a key; expecting ':'.
+    PHASE_COLON,
+    // Expecting a value.
+    PHASE_VALUE,
+    // Inside of a value.
+    PHASE_IN_VALUE,
+    // Inside of a value that has already been handed out by 'json_incr_dict_next_key()'.
+    PHASE_SKIP_VALUE,
+    // After the closing bracket.
+    PHASE_DONE,
+    // An error has occurred.
+    PHASE_ERROR,
+};
+
+enum {
+    KIND_NESTED,
+    KIND_STR,
+    KIND_TOKEN,
+};
+
+// Whether the symbol can be a part of a number or of one of the tokens "true", "false", "null".
+static inline bool is_token_char(char c)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static const bool table[256] = {
+        ['0' ... '9'] = true,
+        ['a' ... 'z'] = true,
+        ['.'] = true,
+        ['-'] = true,
+        ['+'] = true,
+        ['E'] = true,
+    };
+#pragma GCC diagnostic pop
+    return table[(unsigned char) c];
+}
+
+void json_incr_init(JsonIncrCursor *c, size_t offset)
+{
+    *c = (JsonIncrCursor) {.pos = offset, .phase = PHASE_OPEN};
+}
+
+void json_incr_skip_to(JsonIncrCursor *c, size_t offset)
+{
+    c->pos = offset;
+    c->phase = PHASE_SEP;
+}
+
+static int incr_next(
+        JsonIncrCursor *c,
+        const char *buf,
+        const char *buf_end,
+        JsonSpan *k,
+        JsonSpan *v,
+        char open,
+        bool early_key)
+{
+    const char *p = buf + c->pos;
+    const char *q;
+    // ']' == '[' + 2 and '}' == '{' + 2.
+    char close = open + 2;
+    bool is_dict = open == '{';
+
+    for (;;) {
+        switch (c->phase) {
+        case PHASE_OPEN:
+            p = json_scan_skip_ws(p, buf_end);
+            if (p == buf_end)
+                goto need_more;
+            if (unlikely(*p != open))
+                goto error;
+            ++p;
+            c->phase = PHASE_FIRST;
+            break;
+
+        case PHASE_FIRST:
+        case PHASE_SEP:
+            p = json_scan_skip_ws(p, buf_end);
+            if (p == buf_end)
+                goto need_more;
+            if (*p == close) {
+                ++p;
+                c->phase = PHASE_DONE;
+                c->pos = p - buf;
+                return JSON_INCR_END;
+            }
+            if (c->phase == PHASE_SEP) {
+                if (unlikely(*p != ','))
+                    goto error;
+                ++p;
+            }
+            c->phase = is_dict ? PHASE_KEY : PHASE_VALUE;
+            break;
+
+        case PHASE_KEY:
+            p = json_scan_skip_ws(p, buf_end);
+            if (p == buf_end)
+                goto need_more;
+            if (unlikely(*p != '"'))
+                goto error;
+            c->key_begin = p - buf;
+            c->scan = json_scan_state_new();
+            ++p;
+            c->phase = PHASE_IN_KEY;
+            break;
+
+        case PHASE_IN_KEY:
+            q = json_scan_skip_str(&c->scan, p, buf_end);
+            if (!q) {
+                p = buf_end;
+                goto need_more;
+            }
+            p = q;
+            c->key_end = p - buf;
+            c->phase = PHASE_COLON;
+            break;
+
+        case PHASE_COLON:
+            p = json_scan_skip_ws(p, buf_end);
+            if (p == buf_end)
+                goto need_more;
+            if (unlikely(*p != ':'))
+                goto error;
+            ++p;
+            c->phase = PHASE_VALUE;
+            break;
+
+        case PHASE_VALUE:
+            p = json_scan_skip_ws(p, buf_end);
+            if (p == buf_end)
+                goto need_more;
+            c->value_begin = p - buf;
+            c->scan = json_scan_state_new();
+            if ((*p & 0xDF) == 0x5B) {
+                // '[' or '{'; the nested scanner starts at the opening bracket.
+                c->value_kind = KIND_NESTED;
+            } else if (*p == '"') {
+                c->value_kind = KIND_STR;
+                ++p;
+            } else if (is_token_char(*p)) {
+                c->value_kind = KIND_TOKEN;
+                ++p;
+            } else {
+                goto error;
+            }
+            if (early_key) {
+                c->phase = PHASE_SKIP_VALUE;
+                *k = (JsonSpan) {buf + c->key_begin, buf + c->key_end};
+                *v = (JsonSpan) {buf + c->value_begin, NULL};
+                c->pos = p - buf;
+                return JSON_INCR_ELEM;
+            }
+            c->phase = PHASE_IN_VALUE;
+            break;
+
+        case PHASE_IN_VALUE:
+        case PHASE_SKIP_VALUE:
+            switch (c->value_kind) {
+            case KIND_NESTED:
+                q = json_scan_skip_nested(&c->scan, p, buf_end);
+                break;
+            case KIND_STR:
+                q = json_scan_skip_str(&c->scan, p, buf_end);
+                break;
+            default:
+                for (q = p; q != buf_end && is_token_char(*q); ++q) {}
+                if (q == buf_end)
+                    q = NULL;
+                break;
+            }
+            if (!q) {
+                p = buf_end;
+                goto need_more;
+            }
+            if (c->phase == PHASE_SKIP_VALUE) {
+                p = q;
+                c->phase = PHASE_SEP;
+                break;
+            }
+            if (is_dict) {
+                *k = (JsonSpan) {buf + c->key_begin, buf + c->key_end};
+            }
+            *v = (JsonSpan) {buf + c->value_begin, q};
+            c->phase = PHASE_SEP;
+            c->pos = q - buf;
+            return JSON_INCR_ELEM;
+
+        case PHASE_DONE:
+            return JSON_INCR_END;
+
+        default:
+            return JSON_INCR_ERROR;
+        }
+    }
+
+need_more:
+    c->pos = p - buf;
+    return JSON_INCR_NEED_MORE;
+
+error:
+    c->phase = PHASE_ERROR;
+    return JSON_INCR_ERROR;
+}
+
+int json_incr_array_next(JsonIncrCursor *c, const char *buf, const char *buf_end, JsonSpan *e)
+{
+    return incr_next(c, buf, buf_end, NULL, e, '[', false);
+}
+
+int json_incr_dict_next(JsonIncrCursor *c, const char *buf, const char *buf_end, JsonSpan *k, JsonSpan *v)
+{
+    return incr_next(c, buf, buf_end, k, v, '{', false);
+}
+
+int json_incr_dict_next_key(JsonIncrCursor *c, const char *buf, const char *buf_end, JsonSpan *k, JsonSpan *v)
+{
+    return incr_next(c, buf, buf_end, k, v, '{', true);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+#include "json_scan.h"
+
+// Resumable iteration over an array or a dict that is being received piece by piece.
+//
+// The caller keeps appending bytes to a buffer and calls 'json_incr_array_next()' or
+// 'json_incr_dict_next()' with the whole buffer received so far. Each element is handed out as
+// soon as it is complete, that is, as soon as its closing bracket or quote arrives (numbers and
+// literals are only known to be complete when the byte that follows them arrives).
+// If there is no complete element yet, JSON_INCR_NEED_MORE is returned; call again once more
+// bytes have been appended.
+//
+// The cursor only stores offsets, so the buffer may be moved (e.g. reallocated) between calls,
+// provided that the bytes already received are preserved. Spans handed out point into the buffer
+// passed to the call that returned them.
+
+enum {
+    JSON_INCR_ERROR     = -1,
+    JSON_INCR_END       = 0,
+    JSON_INCR_ELEM      = 1,
+    JSON_INCR_NEED_MORE = 2,
+};
+
+typedef struct {
+    // The offset of the next byte to be scanned.
+    size_t pos;
+    // The offsets of the current key (dicts only) and of the beginning of the current value.
+    size_t key_begin;
+    size_t key_end;
+    size_t value_begin;
+    // The state of the scanner inside of the current key or value.
+    JsonScanState scan;
+    uint8_t phase;
+    uint8_t value_kind;
+} JsonIncrCursor;
+
+// Initializes the cursor for the array or dict that begins (possibly after whitespace) at
+// 'offset' bytes from the beginning of the buffer.
+void json_incr_init(JsonIncrCursor *c, size_t offset);
+
+// If there is a complete next element of the array {buf ... buf_end}, writes its span into '*e' and
+// returns JSON_INCR_ELEM.
+// If the array is over, returns JSON_INCR_END.
+// If more bytes are needed to tell either, returns JSON_INCR_NEED_MORE.
+// On error, returns JSON_INCR_ERROR.
+int json_incr_array_next(JsonIncrCursor *c, const char *buf, const char *buf_end, JsonSpan *e);
+
+// Same as 'json_incr_array_next()', but for a dict; writes the spans of the key and the value into
+// '*k' and '*v'.
+int json_incr_dict_next(JsonIncrCursor *c, const char *buf, const char *buf_end, JsonSpan *k, JsonSpan *v);
+
+// Same as 'json_incr_dict_next()', but returns JSON_INCR_ELEM as soon as the key and the first byte
+// of the value are available, setting 'v->begin' and leaving 'v->end' NULL.
+// The next call skips the rest of the value, unless the caller has consumed the value on its own
+// (e.g. with a nested cursor initialized at 'v->begin - buf') and has called
+// 'json_incr_skip_to()'.
+int json_incr_dict_next_key(JsonIncrCursor *c, const char *buf, const char *buf_end, JsonSpan *k, JsonSpan *v);
+
+// Tells the cursor that the current value ends at 'offset' bytes from the beginning of the buffer.
+// For a nested cursor 'n' that has returned JSON_INCR_END, this offset is 'n.pos'.
+void json_incr_skip_to(JsonIncrCursor *c, size_t offset);
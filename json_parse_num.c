@@ -14,7 +14,8 @@ static inline const char *span_rstrip_n(
     return span_end;
 }
 
-int64_t json_parse_num(const char *buf, const char *buf_end, uint8_t scale)
+// The general case: exponents, too many digits and errors.
+static int64_t parse_num_generic(const char *buf, const char *buf_end, uint8_t scale)
 {
     bool negate = false;
     bool negate_e = false;
@@ -127,3 +128,204 @@ done:
 error:
     return INT64_MIN;
 }
+
+// The fast path handles numbers of the form '-?[0-9]*(\.[0-9]*)?' of at most FAST_MAX_LEN bytes
+// that have at most FAST_MAX_DIGITS significant digits left after truncation to 'scale' decimal
+// places; these cannot overflow before the final scaling. Anything else goes to
+// 'parse_num_generic()', so that the results (including errors) are exactly the same.
+//
+// The bytes are held in (little-endian) 64-bit words and processed 8 at a time (SWAR). Numbers are
+// short, so loading them into registers with a few overlapping loads beats copying them into a
+// padded buffer for 16-byte SIMD loads: the latter stalls on store forwarding.
+enum {
+    FAST_MAX_LEN    = 24,
+    FAST_MAX_DIGITS = 18,
+};
+
+static const int64_t POW10[FAST_MAX_DIGITS + 1] = {
+    1ll,
+    10ll,
+    100ll,
+    1000ll,
+    10000ll,
+    100000ll,
+    1000000ll,
+    10000000ll,
+    100000000ll,
+    1000000000ll,
+    10000000000ll,
+    100000000000ll,
+    1000000000000ll,
+    10000000000000ll,
+    100000000000000ll,
+    1000000000000000ll,
+    10000000000000000ll,
+    100000000000000000ll,
+    1000000000000000000ll,
+};
+
+// 'FAST_MAX_LEN / 8' words of data followed by zero words, so that 'get8()' may look past the
+// end.
+typedef struct {
+    uint64_t w[FAST_MAX_LEN / 8 + 3];
+} Words;
+
+static inline uint64_t load64(const char *p)
+{
+    uint64_t x;
+    memcpy(&x, p, 8);
+    return x;
+}
+
+static inline uint32_t load32(const char *p)
+{
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+// Loads 'n' <= FAST_MAX_LEN bytes, zero-padded, without reading past 'p + n'.
+static inline void load_words(Words *ws, const char *p, size_t n)
+{
+    *ws = (Words) {{0}};
+    if (n >= 8) {
+        size_t k = 0;
+        for (; 8 * k + 8 <= n; ++k) {
+            ws->w[k] = load64(p + 8 * k);
+        }
+        size_t rem = n - 8 * k;
+        if (rem) {
+            ws->w[k] = load64(p + n - 8) >> (8 * (8 - rem));
+        }
+    } else if (n >= 4) {
+        uint64_t a = load32(p);
+        uint64_t b = load32(p + n - 4);
+        ws->w[0] = a | (b << (8 * (n - 4)));
+    } else {
+        uint64_t a = 0;
+        for (size_t i = 0; i < n; ++i) {
+            a |= ((uint64_t) (unsigned char) p[i]) << (8 * i);
+        }
+        ws->w[0] = a;
+    }
+}
+
+// Returns the 8 bytes starting at byte 'off'.
+static inline uint64_t get8(const Words *ws, size_t off)
+{
+    size_t i = off / 8;
+    size_t sh = 8 * (off % 8);
+    if (!sh)
+        return ws->w[i];
+    return (ws->w[i] >> sh) | (ws->w[i + 1] << (64 - sh));
+}
+
+// Returns the number of leading bytes of 'x' that are decimal digits (0...8).
+static inline size_t count_digits8(uint64_t x)
+{
+    // Digits become 0...9; then adding 0x76 sets the high bit of a byte iff it was >= 10. Carries
+    // out of a byte only affect the bytes after it, which do not matter.
+    uint64_t t = x ^ 0x3030303030303030ull;
+    uint64_t m = ((t + 0x7676767676767676ull) | t) & 0x8080808080808080ull;
+    return m ? (size_t) __builtin_ctzll(m) / 8 : 8;
+}
+
+// Returns the number of decimal digits starting at byte 'off'.
+static inline size_t count_digits(const Words *ws, size_t off)
+{
+    size_t n = 0;
+    for (;;) {
+        size_t k = count_digits8(get8(ws, off + n));
+        n += k;
+        if (k != 8)
+            return n;
+    }
+}
+
+// Converts 8 ASCII digits (as loaded little-endian into 'v') into a number.
+static inline uint64_t eight_digits(uint64_t v)
+{
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+         (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return v;
+}
+
+// Converts 'n' <= FAST_MAX_DIGITS digits starting at byte 'off' into a number.
+static inline int64_t convert_digits(const Words *ws, size_t off, size_t n)
+{
+    uint64_t r = 0;
+    size_t i = 0;
+    for (; n - i >= 8; i += 8) {
+        r = r * 100000000 + eight_digits(get8(ws, off + i));
+    }
+    size_t j = n - i;
+    if (j) {
+        // Shift the 'j' digits into the most significant bytes and fill the rest with '0'.
+        uint64_t v = get8(ws, off + i) << (8 * (8 - j));
+        v |= 0x3030303030303030ull >> (8 * j);
+        r = r * POW10[j] + eight_digits(v);
+    }
+    return r;
+}
+
+int64_t json_parse_num(const char *buf, const char *buf_end, uint8_t scale)
+{
+    const char *p = buf;
+    bool negate = false;
+    if (p != buf_end && *p == '-') {
+        negate = true;
+        ++p;
+    }
+    size_t n = buf_end - p;
+    if (unlikely(n == 0 || n > FAST_MAX_LEN)) {
+        goto generic;
+    }
+
+    Words ws;
+    load_words(&ws, p, n);
+
+    size_t nint = count_digits(&ws, 0);
+    size_t nfrac = 0;
+    if (nint != n) {
+        if (p[nint] != '.') {
+            goto generic;
+        }
+        nfrac = count_digits(&ws, nint + 1);
+        if (nint + 1 + nfrac != n) {
+            goto generic;
+        }
+    }
+
+    // Truncate the fractional digits that do not fit into 'scale' decimal places.
+    size_t kfrac = nfrac < scale ? nfrac : scale;
+    int32_t s = (int32_t) scale - (int32_t) kfrac;
+    if (nint + kfrac > FAST_MAX_DIGITS) {
+        goto generic;
+    }
+
+    int64_t r = convert_digits(&ws, 0, nint) * POW10[kfrac] + convert_digits(&ws, nint + 1, kfrac);
+    if (r != 0) {
+        if (unlikely(s > FAST_MAX_DIGITS)) {
+            return INT64_MIN;
+        }
+        if (unlikely(__builtin_mul_overflow(r, POW10[s], &r))) {
+            return INT64_MIN;
+        }
+        if (negate) {
+            r = -r;
+        }
+    }
+    return r;
+
+generic:
+    return parse_num_generic(buf, buf_end, scale);
+}
+
+void json_parse_num_batch(const JsonSpan *spans, size_t n, uint8_t scale, int64_t *out)
+{
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = json_parse_num(spans[i].begin, spans[i].end, scale);
+    }
+}
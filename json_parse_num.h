@@ -1,6 +1,10 @@
 #pragma once
 
 #include "common.h"
+#include "json_common.h"
 
 // Returns 'INT64_MIN' on error.
 int64_t json_parse_num(const char *buf, const char *buf_end, uint8_t scale);
+
+// Parses each of the 'n' spans with 'json_parse_num(..., scale)' into 'out'.
+void json_parse_num_batch(const JsonSpan *spans, size_t n, uint8_t scale, int64_t *out);
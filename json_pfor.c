@@ -0,0 +1,108 @@
+#include "json_pfor.h"
+#include "json_visit.h"
+#include "json_visit_validate.h"
+
+typedef struct {
+    const JsonSpan *elems;
+    JsonPforFunc f;
+    JsonPforDoneFunc done;
+    void *arg;
+    unsigned flags;
+
+    // For JSON_PFOR_ORDERED: 'chunk_end[b]' is set to the end of the chunk starting at 'b' once
+    // the chunk is done; 'next' is the first element not yet passed to 'done'. The worker that
+    // finds 'draining' unset takes over calling 'done' for all the chunks that are ready in turn.
+    pthread_mutex_t mtx;
+    size_t *chunk_end;
+    size_t next;
+    bool draining;
+} PforArg;
+
+static void drain_ordered(PforArg *pa, size_t begin, size_t end)
+{
+    pthread_mutex_lock(&pa->mtx);
+    pa->chunk_end[begin] = end;
+    if (pa->draining) {
+        pthread_mutex_unlock(&pa->mtx);
+        return;
+    }
+    pa->draining = true;
+    while (pa->chunk_end[pa->next]) {
+        size_t b = pa->next;
+        size_t e = pa->chunk_end[b];
+        pa->next = e;
+        pthread_mutex_unlock(&pa->mtx);
+        for (size_t i = b; i < e; ++i) {
+            pa->done(pa->arg, i);
+        }
+        pthread_mutex_lock(&pa->mtx);
+    }
+    pa->draining = false;
+    pthread_mutex_unlock(&pa->mtx);
+}
+
+static void pfor_chunk(void *arg, size_t begin, size_t end, int worker)
+{
+    PforArg *pa = arg;
+    for (size_t i = begin; i < end; ++i) {
+        pa->f(pa->arg, pa->elems[i], i, worker);
+        if (pa->done && !(pa->flags & JSON_PFOR_ORDERED)) {
+            pa->done(pa->arg, i);
+        }
+    }
+    if (pa->done && (pa->flags & JSON_PFOR_ORDERED)) {
+        drain_ordered(pa, begin, end);
+    }
+}
+
+int json_pfor(
+        WorkPool *wp,
+        JsonSpan a,
+        size_t chunk,
+        JsonPforFunc f,
+        JsonPforDoneFunc done,
+        void *arg,
+        unsigned flags)
+{
+    JsonSpan *elems = NULL;
+    size_t nelems = 0;
+    size_t cap = 0;
+    int r;
+    for (JsonSpan e = {0};;) {
+        r = (flags & JSON_PFOR_VALIDATE) ? VALIDATE_json_array_next(a, &e) : json_array_next(a, &e);
+        if (r <= 0)
+            break;
+        if (nelems == cap) {
+            elems = x2realloc_or_die(elems, &cap, sizeof(JsonSpan));
+        }
+        elems[nelems++] = e;
+    }
+    if (r < 0) {
+        free(elems);
+        return -1;
+    }
+
+    PforArg pa = {
+        .elems = elems,
+        .f = f,
+        .done = done,
+        .arg = arg,
+        .flags = flags,
+    };
+    bool ordered = done && (flags & JSON_PFOR_ORDERED);
+    if (ordered) {
+        pthread_mutex_init(&pa.mtx, NULL);
+        // One more for the end of the last chunk, which is never set.
+        pa.chunk_end = calloc_or_die(nelems + 1, sizeof(size_t));
+    }
+
+    workpool_run(wp, nelems, chunk, pfor_chunk, &pa);
+
+    if (ordered) {
+        assert(pa.next == nelems);
+        free(pa.chunk_end);
+        pthread_mutex_destroy(&pa.mtx);
+    }
+    free(elems);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+#include "workpool.h"
+
+// A data-parallel loop over the elements of a JSON array, spread over a 'WorkPool'.
+//
+// The element boundaries are found first, in a single sequential pass over the array; the
+// elements are then handed out to the workers in contiguous chunks.
+
+// Called for each element 'elem'; 'i' is its index in the array, 'worker' is the index of the
+// calling worker, 0 <= worker < workpool_nworkers(). Calls for different elements may run at the
+// same time.
+typedef void (*JsonPforFunc)(void *arg, JsonSpan elem, size_t i, int worker);
+
+// Called for element 'i' once 'JsonPforFunc' is done with it.
+typedef void (*JsonPforDoneFunc)(void *arg, size_t i);
+
+enum {
+    // Call the 'JsonPforDoneFunc' in the order of the elements, one at a time (from whichever
+    // worker completes the element that comes next). Otherwise, it is called by the worker that
+    // completed the element, right after it, and calls for different elements may run at the same
+    // time.
+    JSON_PFOR_ORDERED = 1 << 0,
+    // Find the element boundaries with 'VALIDATE_json_array_next()', checking the whole array.
+    JSON_PFOR_VALIDATE = 1 << 1,
+};
+
+// Calls 'f' on each element of the array 'a' and then, if it is not NULL, 'done'; waits until it is
+// all done. 'chunk' is passed to 'workpool_run()'.
+// Returns 0 on success, -1 if 'a' is not a valid array (and then neither 'f' nor 'done' is called).
+int json_pfor(
+        WorkPool *wp,
+        JsonSpan a,
+        size_t chunk,
+        JsonPforFunc f,
+        JsonPforDoneFunc done,
+        void *arg,
+        unsigned flags);
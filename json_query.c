@@ -0,0 +1,437 @@
+#include "json_query.h"
+#include "json_scan.h"
+
+enum {
+    STEP_KEY,
+    STEP_ANY_KEY,
+    STEP_RANGE,
+};
+
+typedef struct {
+    uint8_t kind;
+    // For STEP_KEY.
+    const char *name;
+    size_t nname;
+    // For STEP_RANGE: lo <= i < hi.
+    size_t lo;
+    size_t hi;
+    int child;
+} QueryStep;
+
+// The paths are compiled into a trie; identical prefixes share nodes. As a document is walked,
+// each value is matched by a set of nodes (several, as wildcards and ranges may overlap with
+// other steps).
+typedef struct {
+    QueryStep *steps;
+    int nsteps;
+    size_t capsteps;
+    // The paths ending at this node.
+    int *paths;
+    int npaths;
+    size_t cappaths;
+    bool has_key_steps;
+    bool has_range_steps;
+    // The maximum 'hi' of the range steps.
+    size_t max_hi;
+} QueryNode;
+
+struct JsonQuery {
+    QueryNode *nodes;
+    int nnodes;
+    size_t capnodes;
+    int npaths;
+    // The copies of the paths that the names of STEP_KEY steps point into.
+    char **texts;
+};
+
+typedef struct {
+    const JsonQuery *q;
+    const char *end;
+    JsonQueryFunc f;
+    void *arg;
+} Walk;
+
+static int add_node(JsonQuery *q)
+{
+    if ((size_t) q->nnodes == q->capnodes) {
+        q->nodes = x2realloc_or_die(q->nodes, &q->capnodes, sizeof(QueryNode));
+    }
+    q->nodes[q->nnodes] = (QueryNode) {0};
+    return q->nnodes++;
+}
+
+// Returns the child of 'node' along step 's', adding it if needed.
+static int add_step(JsonQuery *q, int node, QueryStep s)
+{
+    QueryNode *nd = &q->nodes[node];
+    for (int i = 0; i < nd->nsteps; ++i) {
+        QueryStep *t = &nd->steps[i];
+        if (t->kind != s.kind)
+            continue;
+        if (s.kind == STEP_KEY && (t->nname != s.nname || memcmp(t->name, s.name, s.nname) != 0))
+            continue;
+        if (s.kind == STEP_RANGE && (t->lo != s.lo || t->hi != s.hi))
+            continue;
+        return t->child;
+    }
+
+    int child = add_node(q);
+    nd = &q->nodes[node];
+    if ((size_t) nd->nsteps == nd->capsteps) {
+        nd->steps = x2realloc_or_die(nd->steps, &nd->capsteps, sizeof(QueryStep));
+    }
+    s.child = child;
+    nd->steps[nd->nsteps++] = s;
+    if (s.kind == STEP_RANGE) {
+        nd->has_range_steps = true;
+        if (s.hi > nd->max_hi)
+            nd->max_hi = s.hi;
+    } else {
+        nd->has_key_steps = true;
+    }
+    return child;
+}
+
+// Parses a decimal number at '*p', advancing it. Returns false if there is none.
+static bool parse_index(const char **p, size_t *out)
+{
+    const char *s = *p;
+    if (*s < '0' || *s > '9')
+        return false;
+    size_t r = 0;
+    for (; *s >= '0' && *s <= '9'; ++s) {
+        if (__builtin_mul_overflow(r, 10u, &r) || __builtin_add_overflow(r, (size_t) (*s - '0'), &r))
+            return false;
+    }
+    *p = s;
+    *out = r;
+    return true;
+}
+
+// Parses the step at '*p' (just past '[' or '.'), advancing '*p' past it.
+static bool parse_step(const char **p, char opener, QueryStep *out)
+{
+    const char *s = *p;
+    *out = (QueryStep) {0};
+
+    if (opener == '.') {
+        if (*s == '*') {
+            out->kind = STEP_ANY_KEY;
+            *p = s + 1;
+            return true;
+        }
+        size_t n = strcspn(s, ".[");
+        if (!n)
+            return false;
+        out->kind = STEP_KEY;
+        out->name = s;
+        out->nname = n;
+        *p = s + n;
+        return true;
+    }
+
+    if (*s == '\'' || *s == '"') {
+        const char *q = strchr(s + 1, *s);
+        if (!q || q[1] != ']')
+            return false;
+        out->kind = STEP_KEY;
+        out->name = s + 1;
+        out->nname = q - (s + 1);
+        *p = q + 2;
+        return true;
+    }
+
+    if (*s == '*') {
+        if (s[1] != ']')
+            return false;
+        out->kind = STEP_RANGE;
+        out->lo = 0;
+        out->hi = SIZE_MAX;
+        *p = s + 2;
+        return true;
+    }
+
+    out->kind = STEP_RANGE;
+    out->lo = 0;
+    bool has_lo = parse_index(&s, &out->lo);
+    if (*s == ':') {
+        ++s;
+        if (!parse_index(&s, &out->hi))
+            out->hi = SIZE_MAX;
+    } else {
+        if (!has_lo || out->lo == SIZE_MAX)
+            return false;
+        out->hi = out->lo + 1;
+    }
+    if (*s != ']')
+        return false;
+    *p = s + 1;
+    return true;
+}
+
+static bool compile_path(JsonQuery *q, int path, const char *text)
+{
+    const char *p = text;
+    if (*p++ != '$')
+        return false;
+
+    int node = 0;
+    while (*p) {
+        char opener = *p++;
+        if (opener != '.' && opener != '[')
+            return false;
+        QueryStep s;
+        if (!parse_step(&p, opener, &s))
+            return false;
+        node = add_step(q, node, s);
+    }
+
+    QueryNode *nd = &q->nodes[node];
+    if ((size_t) nd->npaths == nd->cappaths) {
+        nd->paths = x2realloc_or_die(nd->paths, &nd->cappaths, sizeof(int));
+    }
+    nd->paths[nd->npaths++] = path;
+    return true;
+}
+
+JsonQuery *json_query_compile(const char *const *paths, int npaths, int *bad_path)
+{
+    JsonQuery *q = calloc_or_die(1, sizeof(JsonQuery));
+    q->npaths = npaths;
+    q->texts = calloc_or_die(npaths ? npaths : 1, sizeof(char *));
+    add_node(q);
+
+    for (int i = 0; i < npaths; ++i) {
+        q->texts[i] = strdup_or_die(paths[i]);
+        if (!compile_path(q, i, q->texts[i])) {
+            if (bad_path) {
+                *bad_path = i;
+            }
+            json_query_free(q);
+            return NULL;
+        }
+    }
+    return q;
+}
+
+void json_query_free(JsonQuery *q)
+{
+    for (int i = 0; i < q->nnodes; ++i) {
+        free(q->nodes[i].steps);
+        free(q->nodes[i].paths);
+    }
+    free(q->nodes);
+    for (int i = 0; i < q->npaths; ++i) {
+        free(q->texts[i]);
+    }
+    free(q->texts);
+    free(q);
+}
+
+int json_query_npaths(const JsonQuery *q)
+{
+    return q->npaths;
+}
+
+static inline const char *skip_ws(const char *p, const char *end)
+{
+    return json_scan_skip_ws(p, end);
+}
+
+// Skips the rest of an array or a dict, given the state after its opening bracket.
+static inline const char *skip_nested_rest(const char *p, const char *end)
+{
+    JsonScanState st = json_scan_state_new();
+    st.depth = 1;
+    return json_scan_skip_nested(&st, p, end);
+}
+
+// Skips the value at 'p' (p != end). Returns NULL on error.
+static const char *skip_value(const char *p, const char *end)
+{
+    char x = *p;
+    if (x == '[' || x == '{') {
+        JsonScanState st = json_scan_state_new();
+        return json_scan_skip_nested(&st, p, end);
+    }
+    if (x == '"') {
+        JsonScanState st = json_scan_state_new();
+        return json_scan_skip_str(&st, p + 1, end);
+    }
+    // A number or one of "true", "false", "null".
+    const char *s = p;
+    while (s != end && !strchr(",]} \t\n\r:", *s)) {
+        ++s;
+    }
+    return s == p ? NULL : s;
+}
+
+static const char *walk(const Walk *w, const char *p, const int *states, int nstates);
+
+static const char *walk_dict(const Walk *w, const char *p, const int *states, int nstates)
+{
+    const JsonQuery *q = w->q;
+    const char *end = w->end;
+    int child[q->nnodes];
+
+    p = skip_ws(p + 1, end);
+    if (unlikely(p == end))
+        return NULL;
+    if (*p == '}')
+        return p + 1;
+
+    for (;;) {
+        if (unlikely(*p != '"'))
+            return NULL;
+        JsonScanState st = json_scan_state_new();
+        const char *k_end = json_scan_skip_str(&st, p + 1, end);
+        if (unlikely(!k_end))
+            return NULL;
+        const char *k = p + 1;
+        size_t nk = k_end - 1 - k;
+
+        int nchild = 0;
+        for (int i = 0; i < nstates; ++i) {
+            const QueryNode *nd = &q->nodes[states[i]];
+            for (int j = 0; j < nd->nsteps; ++j) {
+                const QueryStep *s = &nd->steps[j];
+                if (s->kind == STEP_ANY_KEY ||
+                        (s->kind == STEP_KEY && s->nname == nk && memcmp(s->name, k, nk) == 0)) {
+                    child[nchild++] = s->child;
+                }
+            }
+        }
+
+        p = skip_ws(k_end, end);
+        if (unlikely(p == end || *p != ':'))
+            return NULL;
+        p = skip_ws(p + 1, end);
+        if (unlikely(p == end))
+            return NULL;
+        p = nchild ? walk(w, p, child, nchild) : skip_value(p, end);
+        if (unlikely(!p))
+            return NULL;
+
+        p = skip_ws(p, end);
+        if (unlikely(p == end))
+            return NULL;
+        if (*p == '}')
+            return p + 1;
+        if (unlikely(*p != ','))
+            return NULL;
+        p = skip_ws(p + 1, end);
+        if (unlikely(p == end))
+            return NULL;
+    }
+}
+
+static const char *walk_array(const Walk *w, const char *p, const int *states, int nstates)
+{
+    const JsonQuery *q = w->q;
+    const char *end = w->end;
+    int child[q->nnodes];
+
+    size_t max_hi = 0;
+    for (int i = 0; i < nstates; ++i) {
+        size_t hi = q->nodes[states[i]].max_hi;
+        if (hi > max_hi)
+            max_hi = hi;
+    }
+
+    p = skip_ws(p + 1, end);
+    if (unlikely(p == end))
+        return NULL;
+    if (*p == ']')
+        return p + 1;
+
+    for (size_t idx = 0; ; ++idx) {
+        if (idx == max_hi) {
+            // No range goes further; just find the end of the array.
+            return skip_nested_rest(p, end);
+        }
+
+        int nchild = 0;
+        for (int i = 0; i < nstates; ++i) {
+            const QueryNode *nd = &q->nodes[states[i]];
+            for (int j = 0; j < nd->nsteps; ++j) {
+                const QueryStep *s = &nd->steps[j];
+                if (s->kind == STEP_RANGE && s->lo <= idx && idx < s->hi) {
+                    child[nchild++] = s->child;
+                }
+            }
+        }
+
+        p = nchild ? walk(w, p, child, nchild) : skip_value(p, end);
+        if (unlikely(!p))
+            return NULL;
+
+        p = skip_ws(p, end);
+        if (unlikely(p == end))
+            return NULL;
+        if (*p == ']')
+            return p + 1;
+        if (unlikely(*p != ','))
+            return NULL;
+        p = skip_ws(p + 1, end);
+        if (unlikely(p == end))
+            return NULL;
+    }
+}
+
+// Walks the value at 'p' (p != end) matched by the nodes 'states'. Returns the pointer past the
+// value, or NULL on error.
+static const char *walk(const Walk *w, const char *p, const int *states, int nstates)
+{
+    const JsonQuery *q = w->q;
+    bool into_dict = false;
+    bool into_array = false;
+    for (int i = 0; i < nstates; ++i) {
+        into_dict |= q->nodes[states[i]].has_key_steps;
+        into_array |= q->nodes[states[i]].has_range_steps;
+    }
+
+    const char *v_end;
+    if (*p == '{' && into_dict) {
+        v_end = walk_dict(w, p, states, nstates);
+    } else if (*p == '[' && into_array) {
+        v_end = walk_array(w, p, states, nstates);
+    } else {
+        v_end = skip_value(p, w->end);
+    }
+    if (unlikely(!v_end))
+        return NULL;
+
+    for (int i = 0; i < nstates; ++i) {
+        const QueryNode *nd = &q->nodes[states[i]];
+        for (int j = 0; j < nd->npaths; ++j) {
+            w->f(w->arg, nd->paths[j], (JsonSpan) {p, v_end});
+        }
+    }
+    return v_end;
+}
+
+int json_query_run(const JsonQuery *q, const char *buf, const char *buf_end, JsonQueryFunc f, void *arg)
+{
+    Walk w = {.q = q, .end = buf_end, .f = f, .arg = arg};
+    buf = skip_ws(buf, buf_end);
+    if (unlikely(buf == buf_end))
+        return -1;
+    static const int root[] = {0};
+    return walk(&w, buf, root, 1) ? 0 : -1;
+}
+
+static void store_first(void *arg, int path, JsonSpan v)
+{
+    JsonSpan *out = arg;
+    if (!out[path].begin) {
+        out[path] = v;
+    }
+}
+
+int json_query_first(const JsonQuery *q, const char *buf, const char *buf_end, JsonSpan *out)
+{
+    for (int i = 0; i < q->npaths; ++i) {
+        out[i] = (JsonSpan) {NULL, NULL};
+    }
+    return json_query_run(q, buf, buf_end, store_first, out);
+}
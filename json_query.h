@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+
+// Runtime path queries: a set of paths is compiled once and then matched against documents in a
+// single pass, descending only into the values some path can still reach and skipping the rest.
+//
+// A path starts with '$' (the root value) followed by any number of steps:
+//     .name  or  ['name']  or  ["name"]    the value of key 'name' of a dict;
+//     .*                                   the values of all keys of a dict (while ['*'] is
+//                                          the key '*');
+//     [N]                                  element N of an array;
+//     [*]                                  all elements of an array;
+//     [A:B]                                elements A <= i < B of an array (either may be
+//                                          omitted).
+// Keys are matched like in 'json_parse_dict_fields()' ("sloppy" match, without regard to JSON
+// escapes); quoted names cannot contain escapes or the quote character itself.
+//
+// For example, '$.data[*].orderID' or '$.book.bids[0:10]'.
+
+typedef struct JsonQuery JsonQuery;
+
+// Called for each value matched by path number 'path'. Matches are reported in the order their
+// values end in the buffer, so a match inside another match is reported first.
+typedef void (*JsonQueryFunc)(void *arg, int path, JsonSpan v);
+
+// Compiles 'npaths' paths. On a syntax error, returns NULL and, if 'bad_path' is not NULL, writes
+// the index of the offending path into '*bad_path'.
+JsonQuery *json_query_compile(const char *const *paths, int npaths, int *bad_path);
+
+void json_query_free(JsonQuery *q);
+
+int json_query_npaths(const JsonQuery *q);
+
+// Matches the document at {buf ... buf_end}, calling 'f' for each match.
+// Returns 0 on success, -1 on error; values skipped over are checked for errors no more than by
+// 'json_dict_next()' and the like.
+int json_query_run(const JsonQuery *q, const char *buf, const char *buf_end, JsonQueryFunc f, void *arg);
+
+// Same as 'json_query_run()', but writes the first match of each path 'i' into 'out[i]'
+// ({NULL, NULL} if there is none).
+int json_query_first(const JsonQuery *q, const char *buf, const char *buf_end, JsonSpan *out);
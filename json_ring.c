@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+
+#include "json_ring.h"
+
+#include <sys/mman.h>
+
+enum {
+    // Between values, skipping whitespace.
+    PHASE_BETWEEN,
+    // Inside of an array or a dict.
+    PHASE_NESTED,
+    // Inside of a string.
+    PHASE_STR,
+    // Inside of a number or a literal.
+    PHASE_TOKEN,
+};
+
+// Whether the symbol can be a part of a number or of one of the tokens "true", "false", "null".
+static inline bool is_token_char(char c)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static const bool table[256] = {
+        ['0' ... '9'] = true,
+        ['a' ... 'z'] = true,
+        ['.'] = true,
+        ['-'] = true,
+        ['+'] = true,
+        ['E'] = true,
+    };
+#pragma GCC diagnostic pop
+    return table[(unsigned char) c];
+}
+
+// The byte at 'offset' from the beginning of the stream; the 'capacity' bytes from there on are
+// contiguous.
+static inline char *ring_at(const JsonRing *r, size_t offset)
+{
+    return r->buf + (offset & (r->capacity - 1));
+}
+
+int json_ring_init(JsonRing *r, int fd, size_t capacity)
+{
+    // A power of two, so that offsets wrap around with a mask; pages are, too.
+    size_t min_capacity = capacity;
+    capacity = sysconf(_SC_PAGESIZE);
+    while (capacity < min_capacity) {
+        capacity *= 2;
+    }
+
+    int mfd = memfd_create("json_ring", MFD_CLOEXEC);
+    if (mfd < 0)
+        return -1;
+    if (ftruncate(mfd, capacity) < 0)
+        goto fail_close;
+
+    // Reserve the address range for both copies, then map the same pages over each half.
+    char *buf = mmap(NULL, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED)
+        goto fail_close;
+    for (int i = 0; i < 2; ++i) {
+        void *half = buf + i * capacity;
+        if (mmap(half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, mfd, 0) != half)
+            goto fail_unmap;
+    }
+    close(mfd);
+
+    *r = (JsonRing) {.buf = buf, .capacity = capacity, .fd = fd, .phase = PHASE_BETWEEN};
+    return 0;
+
+fail_unmap:
+    {
+        int saved = errno;
+        munmap(buf, 2 * capacity);
+        errno = saved;
+    }
+fail_close:
+    {
+        int saved = errno;
+        close(mfd);
+        errno = saved;
+    }
+    return -1;
+}
+
+void json_ring_free(JsonRing *r)
+{
+    munmap(r->buf, 2 * r->capacity);
+}
+
+// Scans the bytes received so far. Returns JSON_RING_DOC, JSON_RING_ERROR or, if the value is not
+// complete yet, JSON_RING_AGAIN.
+static int ring_scan(JsonRing *r, JsonSpan *doc)
+{
+    for (;;) {
+        const char *p = ring_at(r, r->pos);
+        const char *end = p + (r->tail - r->pos);
+        const char *q;
+
+        switch (r->phase) {
+        case PHASE_BETWEEN:
+            q = json_scan_skip_ws(p, end);
+            r->pos += q - p;
+            if (q == end)
+                return JSON_RING_AGAIN;
+            r->doc_begin = r->pos;
+            r->scan = json_scan_state_new();
+            if (*q == '{' || *q == '[') {
+                r->phase = PHASE_NESTED;
+            } else if (*q == '"') {
+                r->phase = PHASE_STR;
+                ++r->pos;
+            } else if (is_token_char(*q)) {
+                r->phase = PHASE_TOKEN;
+            } else {
+                return JSON_RING_ERROR;
+            }
+            continue;
+
+        case PHASE_NESTED:
+            q = json_scan_skip_nested(&r->scan, p, end);
+            break;
+
+        case PHASE_STR:
+            q = json_scan_skip_str(&r->scan, p, end);
+            break;
+
+        default: // PHASE_TOKEN
+            for (q = p; q != end && is_token_char(*q); ++q) {
+            }
+            if (q == end) {
+                q = NULL;
+            }
+            break;
+        }
+
+        if (!q) {
+            r->pos = r->tail;
+            return JSON_RING_AGAIN;
+        }
+        r->pos += q - p;
+        break;
+    }
+
+    const char *begin = ring_at(r, r->doc_begin);
+    *doc = (JsonSpan) {begin, begin + (r->pos - r->doc_begin)};
+    r->handed = r->pos;
+    r->phase = PHASE_BETWEEN;
+    return JSON_RING_DOC;
+}
+
+int json_ring_next(JsonRing *r, JsonSpan *doc)
+{
+    for (;;) {
+        int res = ring_scan(r, doc);
+        if (res != JSON_RING_AGAIN)
+            return res;
+
+        if (r->eof) {
+            switch (r->phase) {
+            case PHASE_BETWEEN:
+                return JSON_RING_END;
+            case PHASE_TOKEN: {
+                // The stream is over, so is the token.
+                const char *begin = ring_at(r, r->doc_begin);
+                *doc = (JsonSpan) {begin, begin + (r->pos - r->doc_begin)};
+                r->handed = r->pos;
+                r->phase = PHASE_BETWEEN;
+                return JSON_RING_DOC;
+            }
+            default:
+                return JSON_RING_ERROR;
+            }
+        }
+
+        // With nothing held, only the value being scanned (or nothing, between values) needs to stay.
+        if (r->head == r->handed) {
+            r->head = r->phase == PHASE_BETWEEN ? r->pos : r->doc_begin;
+            r->handed = r->head;
+        }
+        size_t room = r->capacity - (r->tail - r->head);
+        if (!room) {
+            // Only a value being scanned can be too large; between values, 'doc_begin' is stale.
+            if (r->phase != PHASE_BETWEEN && r->head == r->doc_begin) {
+                errno = EMSGSIZE;
+                return JSON_RING_ERROR;
+            }
+            return JSON_RING_FULL;
+        }
+
+        ssize_t n = read(r->fd, ring_at(r, r->tail), room);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return JSON_RING_AGAIN;
+            return JSON_RING_ERROR;
+        }
+        if (!n) {
+            r->eof = true;
+        }
+        r->tail += n;
+    }
+}
+
+void json_ring_release(JsonRing *r, JsonSpan doc)
+{
+    // 'doc' lies within the 'capacity' bytes after 'head', possibly in the second copy of the ring.
+    size_t delta = (doc.begin - ring_at(r, r->head)) & (r->capacity - 1);
+    size_t end = r->head + delta + (doc.end - doc.begin);
+    if (end > r->head && end <= r->handed) {
+        r->head = end;
+    }
+}
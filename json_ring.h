@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+#include "json_scan.h"
+
+// A reader of a stream of concatenated JSON values (e.g. from a socket or a pipe), with or without
+// whitespace between them, that hands out each value in place, in its receive buffer.
+//
+// The receive buffer is a ring whose memory is mapped twice, back to back, so that
+// 'buf[i] == buf[i + capacity]': a value that wraps around the end of the ring is still contiguous,
+// and the reader never copies or moves received bytes. The boundaries of the values are found with
+// the 'json_scan_*' kernels, as they arrive.
+//
+// A value handed out stays valid until it is released with 'json_ring_release()'; the ring cannot
+// be refilled past the oldest value not yet released.
+
+enum {
+    JSON_RING_ERROR = -1,
+    JSON_RING_END   = 0,
+    JSON_RING_DOC   = 1,
+    // The file descriptor is non-blocking and has no data; call again once it does.
+    JSON_RING_AGAIN = 2,
+    // The ring is full of values not yet released (and the beginning of the next one); call again
+    // after releasing some.
+    JSON_RING_FULL  = 3,
+};
+
+typedef struct {
+    // The ring, mapped at 'buf' and again at 'buf + capacity'.
+    char *buf;
+    size_t capacity;
+    int fd;
+    bool eof;
+    // Offsets from the beginning of the stream: the first byte not yet released, the end of the last
+    // value handed out, and the end of the bytes received.
+    size_t head;
+    size_t handed;
+    size_t tail;
+    // The beginning of the value being scanned and the offset of the next byte to be scanned.
+    size_t doc_begin;
+    size_t pos;
+    JsonScanState scan;
+    uint8_t phase;
+} JsonRing;
+
+// Initializes the reader of 'fd' with a ring of at least 'capacity' bytes (rounded up to a power of
+// two, and to at least the page size), which bounds the size of a value. Returns 0 on success, -1 (with 'errno' set)
+// on error. 'fd' is not closed by 'json_ring_free()'.
+int json_ring_init(JsonRing *r, int fd, size_t capacity);
+
+void json_ring_free(JsonRing *r);
+
+// If there is a complete next value, writes its span into '*doc' and returns JSON_RING_DOC; reads
+// from the file descriptor as needed.
+// If the stream is over (there is nothing but whitespace until its end), returns JSON_RING_END.
+// If the stream is malformed (e.g. ends in the middle of a value), a value does not fit into the
+// ring ('errno' is set to EMSGSIZE) or 'read()' fails, returns JSON_RING_ERROR.
+// Returns JSON_RING_AGAIN and JSON_RING_FULL as described above.
+//
+// Scalars are handed out as well; a number or a literal at the very end of the stream is only
+// known to be complete once the stream is over.
+int json_ring_next(JsonRing *r, JsonSpan *doc);
+
+// Releases 'doc', which must have been handed out by 'json_ring_next()', and all the values handed
+// out before it.
+void json_ring_release(JsonRing *r, JsonSpan doc);
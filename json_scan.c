@@ -0,0 +1,171 @@
+#include "json_scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+# define JSON_SCAN_X86 1
+# include <immintrin.h>
+#else
+# define JSON_SCAN_X86 0
+#endif
+
+// Counts the backslashes immediately preceding 'end', not looking before 'begin'; then tells
+// whether the byte at 'end' is escaped, given that the byte at 'begin' is escaped iff
+// 'begin_escaped'.
+static inline bool scalar_is_escaped(const char *begin, const char *end, bool begin_escaped)
+{
+    const char *p = end;
+    while (p != begin && p[-1] == '\\') {
+        --p;
+    }
+    size_t nbslash = end - p;
+    if (p == begin) {
+        nbslash += begin_escaped;
+    }
+    return nbslash & 1;
+}
+
+static const char *skip_str_scalar(JsonScanState *st, const char *buf, const char *buf_end)
+{
+    const char *begin = buf;
+    while (buf != buf_end) {
+        const char *q = memchr(buf, '"', buf_end - buf);
+        if (!q) {
+            break;
+        }
+        if (!scalar_is_escaped(begin, q, st->escaped)) {
+            return q + 1;
+        }
+        buf = q + 1;
+    }
+    st->escaped = scalar_is_escaped(begin, buf_end, st->escaped);
+    return NULL;
+}
+
+static const char *skip_nested_scalar(JsonScanState *st, const char *buf, const char *buf_end)
+{
+    static const int8_t table[256] = {
+        ['['] = 1,
+        ['{'] = 1,
+        [']'] = -1,
+        ['}'] = -1,
+    };
+
+    size_t depth = st->depth;
+    for (;;) {
+        if (st->in_str) {
+            buf = skip_str_scalar(st, buf, buf_end);
+            if (!buf) {
+                break;
+            }
+            st->in_str = false;
+            st->escaped = false;
+        }
+        for (;;) {
+            if (unlikely(buf == buf_end)) {
+                goto out;
+            }
+            char y = *buf++;
+            if (y == '"') {
+                st->in_str = true;
+                break;
+            }
+            depth += table[(unsigned char) y];
+            if (depth == 0) {
+                st->depth = 0;
+                return buf;
+            }
+        }
+    }
+out:
+    st->depth = depth;
+    return NULL;
+}
+
+static const char *skip_ws_scalar(const char *buf, const char *buf_end)
+{
+    for (; buf != buf_end; ++buf) {
+        char c = *buf;
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            break;
+        }
+    }
+    return buf;
+}
+
+static const JsonScanImpl IMPL_SCALAR = {
+    .skip_nested = skip_nested_scalar,
+    .skip_str    = skip_str_scalar,
+    .skip_ws     = skip_ws_scalar,
+    .name        = "scalar",
+};
+
+#if JSON_SCAN_X86
+
+# define JSON_SCAN_AVX2 0
+# include "json_scan.c.tpl"
+# undef JSON_SCAN_AVX2
+
+# define JSON_SCAN_AVX2 1
+# include "json_scan.c.tpl"
+# undef JSON_SCAN_AVX2
+
+static const JsonScanImpl IMPL_SSE2 = {
+    .skip_nested = skip_nested_sse2,
+    .skip_str    = skip_str_sse2,
+    .skip_ws     = skip_ws_sse2,
+    .name        = "sse2",
+};
+
+static const JsonScanImpl IMPL_AVX2 = {
+    .skip_nested = skip_nested_avx2,
+    .skip_str    = skip_str_avx2,
+    .skip_ws     = skip_ws_avx2,
+    .name        = "avx2",
+};
+
+#endif
+
+const JsonScanImpl *json_scan_impl = &IMPL_SCALAR;
+
+bool json_scan_select(int which)
+{
+    const JsonScanImpl *impl = NULL;
+
+    switch (which) {
+    case JSON_SCAN_IMPL_SCALAR:
+        impl = &IMPL_SCALAR;
+        break;
+#if JSON_SCAN_X86
+    case JSON_SCAN_IMPL_SSE2:
+        if (__builtin_cpu_supports("sse2")) {
+            impl = &IMPL_SSE2;
+        }
+        break;
+    case JSON_SCAN_IMPL_AVX2:
+        if (__builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("pclmul") &&
+            __builtin_cpu_supports("popcnt") &&
+            __builtin_cpu_supports("bmi"))
+        {
+            impl = &IMPL_AVX2;
+        }
+        break;
+#endif
+    case JSON_SCAN_IMPL_AUTO:
+        return json_scan_select(JSON_SCAN_IMPL_AVX2)
+            || json_scan_select(JSON_SCAN_IMPL_SSE2)
+            || json_scan_select(JSON_SCAN_IMPL_SCALAR);
+    }
+
+    if (!impl) {
+        return false;
+    }
+    json_scan_impl = impl;
+    return true;
+}
+
+__attribute__((constructor))
+static void json_scan_init(void)
+{
+    __builtin_cpu_init();
+    json_scan_select(JSON_SCAN_IMPL_AUTO);
+}
@@ -0,0 +1,286 @@
+// This file is included by 'json_scan.c' once per instruction set, with JSON_SCAN_AVX2 set to
+// either 0 (SSE2 + prefix XOR by shifts) or 1 (AVX2 + carry-less multiplication).
+//
+// Every function is compiled for its instruction set with a 'target' attribute (rather than with
+// '#pragma GCC target', which clang ignores).
+
+#if JSON_SCAN_AVX2
+# define SCAN_FN(Name_) Name_ ## _avx2
+# define SCAN_TARGET    __attribute__((target("avx2,pclmul,popcnt,bmi")))
+#else
+# define SCAN_FN(Name_) Name_ ## _sse2
+# define SCAN_TARGET    __attribute__((target("sse2")))
+#endif
+
+// Bitmasks of a 64-byte block: bit 'i' corresponds to 'block[i]'.
+typedef struct {
+    uint64_t quote;
+    uint64_t bslash;
+    uint64_t open;
+    uint64_t close;
+} SCAN_FN(Block);
+
+#if JSON_SCAN_AVX2
+
+SCAN_TARGET
+static inline uint64_t SCAN_FN(mask_eq)(__m256i lo, __m256i hi, char c)
+{
+    __m256i x = _mm256_set1_epi8(c);
+    uint32_t m_lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, x));
+    uint32_t m_hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, x));
+    return m_lo | (((uint64_t) m_hi) << 32);
+}
+
+SCAN_TARGET
+static inline void SCAN_FN(load_str)(const char *p, SCAN_FN(Block) *b)
+{
+    __m256i lo = _mm256_loadu_si256((const __m256i *) p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *) (p + 32));
+    b->quote = SCAN_FN(mask_eq)(lo, hi, '"');
+    b->bslash = SCAN_FN(mask_eq)(lo, hi, '\\');
+}
+
+SCAN_TARGET
+static inline void SCAN_FN(load_all)(const char *p, SCAN_FN(Block) *b)
+{
+    __m256i lo = _mm256_loadu_si256((const __m256i *) p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *) (p + 32));
+    b->quote = SCAN_FN(mask_eq)(lo, hi, '"');
+    b->bslash = SCAN_FN(mask_eq)(lo, hi, '\\');
+    // '[' | 0x20 == '{' and ']' | 0x20 == '}'; no other byte maps onto these.
+    __m256i bit5 = _mm256_set1_epi8(0x20);
+    lo = _mm256_or_si256(lo, bit5);
+    hi = _mm256_or_si256(hi, bit5);
+    b->open = SCAN_FN(mask_eq)(lo, hi, '{');
+    b->close = SCAN_FN(mask_eq)(lo, hi, '}');
+}
+
+SCAN_TARGET
+static inline uint64_t SCAN_FN(load_ws)(const char *p)
+{
+    __m256i lo = _mm256_loadu_si256((const __m256i *) p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *) (p + 32));
+    return SCAN_FN(mask_eq)(lo, hi, ' ')
+         | SCAN_FN(mask_eq)(lo, hi, '\n')
+         | SCAN_FN(mask_eq)(lo, hi, '\r')
+         | SCAN_FN(mask_eq)(lo, hi, '\t');
+}
+
+// Bit 'i' of the result is the XOR of bits 0...i of 'x'.
+SCAN_TARGET
+static inline uint64_t SCAN_FN(prefix_xor)(uint64_t x)
+{
+    __m128i all_ones = _mm_set1_epi8(-1);
+    __m128i r = _mm_clmulepi64_si128(_mm_set_epi64x(0, x), all_ones, 0);
+    return _mm_cvtsi128_si64(r);
+}
+
+#else
+
+SCAN_TARGET
+static inline uint64_t SCAN_FN(mask_eq)(const __m128i *v, char c)
+{
+    __m128i x = _mm_set1_epi8(c);
+    uint64_t m0 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v[0], x));
+    uint64_t m1 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v[1], x));
+    uint64_t m2 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v[2], x));
+    uint64_t m3 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v[3], x));
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+SCAN_TARGET
+static inline void SCAN_FN(load4)(const char *p, __m128i *v)
+{
+    for (int i = 0; i < 4; ++i) {
+        v[i] = _mm_loadu_si128((const __m128i *) (p + 16 * i));
+    }
+}
+
+SCAN_TARGET
+static inline void SCAN_FN(load_str)(const char *p, SCAN_FN(Block) *b)
+{
+    __m128i v[4];
+    SCAN_FN(load4)(p, v);
+    b->quote = SCAN_FN(mask_eq)(v, '"');
+    b->bslash = SCAN_FN(mask_eq)(v, '\\');
+}
+
+SCAN_TARGET
+static inline void SCAN_FN(load_all)(const char *p, SCAN_FN(Block) *b)
+{
+    __m128i v[4];
+    SCAN_FN(load4)(p, v);
+    b->quote = SCAN_FN(mask_eq)(v, '"');
+    b->bslash = SCAN_FN(mask_eq)(v, '\\');
+    // '[' | 0x20 == '{' and ']' | 0x20 == '}'; no other byte maps onto these.
+    __m128i bit5 = _mm_set1_epi8(0x20);
+    for (int i = 0; i < 4; ++i) {
+        v[i] = _mm_or_si128(v[i], bit5);
+    }
+    b->open = SCAN_FN(mask_eq)(v, '{');
+    b->close = SCAN_FN(mask_eq)(v, '}');
+}
+
+SCAN_TARGET
+static inline uint64_t SCAN_FN(load_ws)(const char *p)
+{
+    __m128i v[4];
+    SCAN_FN(load4)(p, v);
+    return SCAN_FN(mask_eq)(v, ' ')
+         | SCAN_FN(mask_eq)(v, '\n')
+         | SCAN_FN(mask_eq)(v, '\r')
+         | SCAN_FN(mask_eq)(v, '\t');
+}
+
+// Bit 'i' of the result is the XOR of bits 0...i of 'x'.
+SCAN_TARGET
+static inline uint64_t SCAN_FN(prefix_xor)(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+#endif
+
+// Returns the mask of escaped bytes in a block, given the mask of backslashes and whether the
+// first byte of the block is escaped.
+//
+// A backslash escapes the next byte unless it is escaped itself. Sequences of backslashes that
+// start on even and odd positions are told apart with a single addition, which propagates carries
+// through each run of backslashes.
+SCAN_TARGET
+static inline uint64_t SCAN_FN(find_escaped)(uint64_t bslash, bool first_escaped)
+{
+    static const uint64_t EVEN_BITS = 0x5555555555555555ull;
+
+    if (!bslash) {
+        return first_escaped;
+    }
+    bslash &= ~(uint64_t) first_escaped;
+    uint64_t follows_escape = (bslash << 1) | first_escaped;
+    uint64_t odd_starts = bslash & ~EVEN_BITS & ~follows_escape;
+    uint64_t even_starts_ends = odd_starts + bslash;
+    uint64_t invert_mask = even_starts_ends << 1;
+    return (EVEN_BITS ^ invert_mask) & follows_escape;
+}
+
+// Loads a block of 'n' < 64 bytes, padding it with spaces.
+#define SCAN_LOAD_TAIL(LoadFn_, P_, N_, ...) \
+    do { \
+        char tail_[64]; \
+        memcpy(tail_, (P_), (N_)); \
+        memset(tail_ + (N_), ' ', 64 - (N_)); \
+        LoadFn_(tail_, __VA_ARGS__); \
+    } while (0)
+
+SCAN_TARGET
+static const char *SCAN_FN(skip_nested)(JsonScanState *st, const char *buf, const char *buf_end)
+{
+    size_t depth = st->depth;
+    uint64_t in_str = -(uint64_t) st->in_str;
+    bool escaped = st->escaped;
+
+    while (buf != buf_end) {
+        size_t n = buf_end - buf;
+        SCAN_FN(Block) b;
+        if (likely(n >= 64)) {
+            n = 64;
+            SCAN_FN(load_all)(buf, &b);
+        } else {
+            SCAN_LOAD_TAIL(SCAN_FN(load_all), buf, n, &b);
+        }
+
+        uint64_t esc = SCAN_FN(find_escaped)(b.bslash, escaped);
+        uint64_t quote = b.quote & ~esc;
+        in_str ^= SCAN_FN(prefix_xor)(quote);
+        uint64_t open = b.open & ~in_str;
+        uint64_t close = b.close & ~in_str;
+
+        if (likely(depth > (size_t) __builtin_popcountll(close))) {
+            // The depth cannot drop to zero inside of this block.
+            depth += __builtin_popcountll(open);
+            depth -= __builtin_popcountll(close);
+        } else {
+            for (uint64_t s = open | close; s; s &= s - 1) {
+                uint64_t bit = s & -s;
+                if (open & bit) {
+                    ++depth;
+                } else if (--depth == 0) {
+                    return buf + __builtin_ctzll(bit) + 1;
+                }
+            }
+        }
+
+        in_str = -((in_str >> (n - 1)) & 1);
+        escaped = ((b.bslash & ~esc) >> (n - 1)) & 1;
+        buf += n;
+    }
+
+    st->depth = depth;
+    st->in_str = in_str;
+    st->escaped = escaped;
+    return NULL;
+}
+
+SCAN_TARGET
+static const char *SCAN_FN(skip_str)(JsonScanState *st, const char *buf, const char *buf_end)
+{
+    bool escaped = st->escaped;
+
+    while (buf != buf_end) {
+        size_t n = buf_end - buf;
+        SCAN_FN(Block) b;
+        if (likely(n >= 64)) {
+            n = 64;
+            SCAN_FN(load_str)(buf, &b);
+        } else {
+            SCAN_LOAD_TAIL(SCAN_FN(load_str), buf, n, &b);
+        }
+
+        uint64_t esc = SCAN_FN(find_escaped)(b.bslash, escaped);
+        uint64_t quote = b.quote & ~esc;
+        if (quote) {
+            return buf + __builtin_ctzll(quote) + 1;
+        }
+
+        escaped = ((b.bslash & ~esc) >> (n - 1)) & 1;
+        buf += n;
+    }
+
+    st->escaped = escaped;
+    return NULL;
+}
+
+SCAN_TARGET
+static const char *SCAN_FN(skip_ws)(const char *buf, const char *buf_end)
+{
+    while (buf != buf_end) {
+        size_t n = buf_end - buf;
+        uint64_t ws;
+        if (likely(n >= 64)) {
+            n = 64;
+            ws = SCAN_FN(load_ws)(buf);
+        } else {
+            char tail[64];
+            memcpy(tail, buf, n);
+            memset(tail + n, 'x', 64 - n);
+            ws = SCAN_FN(load_ws)(tail);
+        }
+
+        if (~ws) {
+            size_t i = __builtin_ctzll(~ws);
+            return i < n ? buf + i : buf_end;
+        }
+        buf += n;
+    }
+    return buf;
+}
+
+#undef SCAN_LOAD_TAIL
+#undef SCAN_FN
+#undef SCAN_TARGET
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+
+// Block-oriented scanning kernels used by 'json_visit' to skip over values.
+//
+// Every kernel has a scalar implementation (the reference one) and, on x86-64, SSE2 and AVX2
+// implementations that process the input in 64-byte blocks: they build bitmasks of quotes,
+// backslashes and brackets, find escaped characters and in-string regions with carry-less
+// multiplication/prefix-XOR tricks, and track the nesting depth a whole block at a time.
+//
+// The best implementation supported by the CPU is selected at startup; see 'json_scan_select()'.
+//
+// Scanning is resumable: all the state needed to continue is kept in 'JsonScanState', so that a
+// kernel may be called on consecutive pieces of the same input.
+
+typedef struct {
+    // The current nesting level of '['/'{' versus ']'/'}'.
+    size_t depth;
+    // Whether the next byte is inside a string.
+    bool in_str;
+    // Whether the next byte is escaped (preceded by an odd number of backslashes in a string).
+    bool escaped;
+} JsonScanState;
+
+typedef struct {
+    // Scans {buf ... buf_end} tracking brackets and strings. Returns the pointer past the closing
+    // bracket that brings 'st->depth' down to zero; or, if there is none, updates '*st' and
+    // returns NULL.
+    // To skip an array or a dict, start with a zero state and 'buf' pointing to its opening
+    // bracket.
+    const char *(*skip_nested)(JsonScanState *st, const char *buf, const char *buf_end);
+
+    // Scans {buf ... buf_end} that is inside a string. Returns the pointer past the closing
+    // (unescaped) quote; or, if there is none, updates 'st->escaped' and returns NULL.
+    const char *(*skip_str)(JsonScanState *st, const char *buf, const char *buf_end);
+
+    // Skips until either a non-whitespace (as per JSON standard) symbol is found, or the end of
+    // the buffer is reached.
+    const char *(*skip_ws)(const char *buf, const char *buf_end);
+
+    const char *name;
+} JsonScanImpl;
+
+enum {
+    JSON_SCAN_IMPL_AUTO,
+    JSON_SCAN_IMPL_SCALAR,
+    JSON_SCAN_IMPL_SSE2,
+    JSON_SCAN_IMPL_AVX2,
+};
+
+extern const JsonScanImpl *json_scan_impl;
+
+// Selects the implementation to be used by the 'json_scan_*' functions (one of the
+// JSON_SCAN_IMPL_* constants; JSON_SCAN_IMPL_AUTO selects the best one supported by the CPU).
+// Returns false (and leaves the current selection unchanged) if the implementation is not
+// supported either by the CPU or by this build.
+//
+// This is not thread-safe; it is meant to be called at startup or from tests and benchmarks.
+bool json_scan_select(int which);
+
+in_header JsonScanState json_scan_state_new(void)
+{
+    return (JsonScanState) {.depth = 0, .in_str = false, .escaped = false};
+}
+
+in_header const char *json_scan_skip_nested(JsonScanState *st, const char *buf, const char *buf_end)
+{
+    return json_scan_impl->skip_nested(st, buf, buf_end);
+}
+
+in_header const char *json_scan_skip_str(JsonScanState *st, const char *buf, const char *buf_end)
+{
+    return json_scan_impl->skip_str(st, buf, buf_end);
+}
+
+in_header const char *json_scan_skip_ws(const char *buf, const char *buf_end)
+{
+    return json_scan_impl->skip_ws(buf, buf_end);
+}
@@ -0,0 +1,79 @@
+#include "json_stats.h"
+
+__thread JsonStatsThread json_stats_thread;
+
+static void hist_merge(JsonStatsHist *into, const JsonStatsHist *from)
+{
+    into->count += from->count;
+    into->sum += from->sum;
+    for (int i = 0; i < JSON_STATS_NBUCKETS; ++i) {
+        into->buckets[i] += from->buckets[i];
+    }
+}
+
+void json_stats_merge(JsonStatsCounters *into, const JsonStatsCounters *from)
+{
+    into->calls += from->calls;
+    into->bytes += from->bytes;
+    into->bytes_matched += from->bytes_matched;
+    into->dict_steps += from->dict_steps;
+    into->array_steps += from->array_steps;
+    into->yield_checks += from->yield_checks;
+    into->yields += from->yields;
+    hist_merge(&into->bytes_per_call, &from->bytes_per_call);
+    hist_merge(&into->steps_per_call, &from->steps_per_call);
+    hist_merge(&into->run_ticks, &from->run_ticks);
+}
+
+void json_stats_snapshot(JsonStatsCounters *out)
+{
+    JsonStatsThread *t = &json_stats_thread;
+    *out = t->unattributed;
+    for (const JsonStatsSite *site = t->sites; site; site = site->next) {
+        json_stats_merge(out, &site->c);
+    }
+}
+
+const JsonStatsCounters *json_stats_unattributed(void)
+{
+    return &json_stats_thread.unattributed;
+}
+
+const JsonStatsSite *json_stats_sites(void)
+{
+    return json_stats_thread.sites;
+}
+
+void json_stats_reset(void)
+{
+    JsonStatsThread *t = &json_stats_thread;
+    t->unattributed = (JsonStatsCounters) {0};
+    for (JsonStatsSite *site = t->sites; site; site = site->next) {
+        site->c = (JsonStatsCounters) {0};
+    }
+}
+
+static void hist_print(FILE *f, const char *name, const JsonStatsHist *h)
+{
+    if (!h->count)
+        return;
+    fprintf(f, "  %s: count %" PRIu64 ", mean %.1f\n", name, h->count, (double) h->sum / h->count);
+    for (int i = 0; i < JSON_STATS_NBUCKETS; ++i) {
+        if (!h->buckets[i])
+            continue;
+        uint64_t lo = i ? 1ull << (i - 1) : 0;
+        fprintf(f, "    >= %-20" PRIu64 " %" PRIu64 "\n", lo, h->buckets[i]);
+    }
+}
+
+void json_stats_print(FILE *f, const char *title, const JsonStatsCounters *c)
+{
+    fprintf(f, "%s:\n", title);
+    fprintf(f, "  calls %" PRIu64 ", bytes %" PRIu64 " (matched %" PRIu64 ", skipped %" PRIu64 ")\n",
+            c->calls, c->bytes, c->bytes_matched, c->bytes - c->bytes_matched);
+    fprintf(f, "  dict steps %" PRIu64 ", array steps %" PRIu64 "\n", c->dict_steps, c->array_steps);
+    fprintf(f, "  yield checks %" PRIu64 ", yields %" PRIu64 "\n", c->yield_checks, c->yields);
+    hist_print(f, "bytes per call", &c->bytes_per_call);
+    hist_print(f, "steps per call", &c->steps_per_call);
+    hist_print(f, "run ticks between yields", &c->run_ticks);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "common.h"
+
+// Hot-path instrumentation of the parser and of preemption.
+//
+// It is compiled out unless 'JSON_STATS' is defined to 1 (e.g. with '-DJSON_STATS=1'; it must be
+// the same for all the translation units). The counters are per thread; each thread only ever
+// sees its own.
+//
+// The counters can be attributed to a call site: within 'JSON_STATS_AT(&site, EXPR)', everything
+// the calling thread counts goes to 'site' (declared with 'JSON_STATS_SITE()') instead of to the
+// thread's unattributed counters. The DSL generates these for variables with the stats flag on.
+// A fiber's site is saved on yield and restored on resume, so that fibers interleaved on a thread
+// keep their attribution.
+
+#ifndef JSON_STATS
+# define JSON_STATS 0
+#endif
+
+// Bucket 0 counts zeroes, bucket 'i' > 0 counts values in [2^(i-1), 2^i).
+enum { JSON_STATS_NBUCKETS = 65 };
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t buckets[JSON_STATS_NBUCKETS];
+} JsonStatsHist;
+
+typedef struct {
+    // Calls of the 'json_parse_*' functions, the bytes they were given and the bytes of the values
+    // they found (the rest was skipped over; with 'json_parse_plan()', only the values without a
+    // node of their own count as found).
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t bytes_matched;
+    // Key-value pairs and array elements stepped over, by the 'json_parse_*' functions or directly.
+    uint64_t dict_steps;
+    uint64_t array_steps;
+    // Calls of 'preempt_maybe_yield*()' and how many of them actually yielded.
+    uint64_t yield_checks;
+    uint64_t yields;
+
+    // Per call of a 'json_parse_*' function.
+    JsonStatsHist bytes_per_call;
+    JsonStatsHist steps_per_call;
+    // Time a fiber ran between being resumed (or creating its preempt device) and yielding, in
+    // 'ticks_now()' ticks.
+    JsonStatsHist run_ticks;
+} JsonStatsCounters;
+
+typedef struct JsonStatsSite {
+    const char *name;
+    const char *file;
+    int line;
+    JsonStatsCounters c;
+    // Set when the site is first entered on the thread.
+    bool registered;
+    struct JsonStatsSite *next;
+} JsonStatsSite;
+
+typedef struct {
+    JsonStatsCounters unattributed;
+    JsonStatsSite *cur_site;
+    JsonStatsSite *sites;
+    uint64_t run_start;
+} JsonStatsThread;
+
+extern __thread JsonStatsThread json_stats_thread;
+
+// Writes the sum of the calling thread's counters, attributed or not, into '*out'.
+void json_stats_snapshot(JsonStatsCounters *out);
+
+// Returns the calling thread's unattributed counters.
+const JsonStatsCounters *json_stats_unattributed(void);
+
+// Returns the first of the calling thread's sites (linked with 'next'), in the order they were
+// first entered, or NULL.
+const JsonStatsSite *json_stats_sites(void);
+
+// Zeroes all the counters of the calling thread.
+void json_stats_reset(void);
+
+void json_stats_merge(JsonStatsCounters *into, const JsonStatsCounters *from);
+
+// Prints the counters and the non-empty histogram buckets in a human-readable form.
+void json_stats_print(FILE *f, const char *title, const JsonStatsCounters *c);
+
+in_header JsonStatsCounters *json_stats_counters(void)
+{
+    JsonStatsThread *t = &json_stats_thread;
+    return t->cur_site ? &t->cur_site->c : &t->unattributed;
+}
+
+in_header void json_stats_hist_add(JsonStatsHist *h, uint64_t x)
+{
+    ++h->count;
+    h->sum += x;
+    ++h->buckets[x ? 64 - __builtin_clzll(x) : 0];
+}
+
+in_header JsonStatsSite *json_stats_enter(JsonStatsSite *site)
+{
+    JsonStatsThread *t = &json_stats_thread;
+    if (unlikely(!site->registered)) {
+        site->registered = true;
+        // Append, to keep the order of first entry.
+        JsonStatsSite **p = &t->sites;
+        while (*p) {
+            p = &(*p)->next;
+        }
+        *p = site;
+    }
+    JsonStatsSite *prev = t->cur_site;
+    t->cur_site = site;
+    return prev;
+}
+
+in_header void json_stats_leave(JsonStatsSite *prev)
+{
+    json_stats_thread.cur_site = prev;
+}
+
+typedef struct {
+    JsonStatsCounters *c;
+    uint64_t steps;
+} JsonStatsCall;
+
+in_header JsonStatsCall json_stats_call_begin(const char *buf, const char *buf_end)
+{
+    JsonStatsCounters *c = json_stats_counters();
+    ++c->calls;
+    c->bytes += buf_end - buf;
+    json_stats_hist_add(&c->bytes_per_call, buf_end - buf);
+    return (JsonStatsCall) {c, c->dict_steps + c->array_steps};
+}
+
+in_header void json_stats_call_end(JsonStatsCall *call)
+{
+    JsonStatsCounters *c = call->c;
+    json_stats_hist_add(&c->steps_per_call, c->dict_steps + c->array_steps - call->steps);
+}
+
+#if JSON_STATS
+
+// Declares the site 'Var_' named 'Name_' (a string literal).
+# define JSON_STATS_SITE(Var_, Name_) \
+    static __thread JsonStatsSite Var_ = {.name = (Name_), .file = __FILE__, .line = __LINE__}
+
+// Evaluates 'Expr_' with the counters attributed to the site at 'Site_'.
+# define JSON_STATS_AT(Site_, Expr_) \
+    __extension__ ({ \
+        JsonStatsSite *__stats_prev = json_stats_enter(Site_); \
+        __typeof__(Expr_) __stats_r = (Expr_); \
+        json_stats_leave(__stats_prev); \
+        __stats_r; \
+    })
+
+# define JSON_STATS_ADD(Field_, N_)   ((void) (json_stats_counters()->Field_ += (N_)))
+# define JSON_STATS_HIST(Field_, X_)  json_stats_hist_add(&json_stats_counters()->Field_, (X_))
+
+// Counts a call of a 'json_parse_*' function on {Buf_ ... BufEnd_}; goes at the top of its body.
+# define JSON_STATS_CALL(Buf_, BufEnd_) \
+    __attribute__((cleanup(json_stats_call_end), unused)) \
+    JsonStatsCall __stats_call = json_stats_call_begin((Buf_), (BufEnd_))
+
+#else
+
+# define JSON_STATS_SITE(Var_, Name_)  __attribute__((unused)) static const char Var_ = 0
+# define JSON_STATS_AT(Site_, Expr_)   (Expr_)
+# define JSON_STATS_ADD(Field_, N_)    ((void) 0)
+# define JSON_STATS_HIST(Field_, X_)   ((void) 0)
+# define JSON_STATS_CALL(Buf_, BufEnd_) ((void) 0)
+
+#endif
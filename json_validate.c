@@ -0,0 +1,541 @@
+#include "json_validate.h"
+#include "json_scan.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+# define JSON_VALIDATE_X86 1
+# include <immintrin.h>
+#else
+# define JSON_VALIDATE_X86 0
+#endif
+
+static inline bool is_ws(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Returns the pointer past the run of digits at 'p'.
+//
+// While at least 8 bytes are left, they are checked at once (SWAR): after XOR with '0', a byte is a
+// digit iff it is below 10, i.e. iff adding 0x76 leaves its most significant bit clear. A carry out
+// of a byte only affects the bytes after it, so the lowest flagged byte is the first non-digit.
+static inline const char *skip_digits(const char *p, const char *end)
+{
+    while (end - p >= 8) {
+        uint64_t x;
+        memcpy(&x, p, 8);
+        x ^= 0x3030303030303030ull;
+        uint64_t non_digit = ((x + 0x7676767676767676ull) | x) & 0x8080808080808080ull;
+        if (non_digit) {
+            return p + (__builtin_ctzll(non_digit) >> 3);
+        }
+        p += 8;
+    }
+    while (p != end && is_digit(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+static inline const char *skip_ws(const char *p, const char *end)
+{
+    // Most of the time there is either no whitespace at all or a single space.
+    if (p == end || !is_ws(*p))
+        return p;
+    ++p;
+    if (p == end || !is_ws(*p))
+        return p;
+    return json_scan_skip_ws(p, end);
+}
+
+// Whether the byte needs a closer look inside a string: a quote, a backslash, a control byte or
+// a non-ASCII byte.
+static inline bool is_str_special(char c)
+{
+    unsigned char x = c;
+    return x == '"' || x == '\\' || x < 0x20 || x >= 0x80;
+}
+
+// Returns the pointer to the first byte in {p ... end} for which 'is_str_special()' holds, or
+// 'end'.
+static inline const char *find_str_special(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) p);
+        __m128i quote = _mm_cmpeq_epi8(x, _mm_set1_epi8('"'));
+        __m128i bslash = _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'));
+        // x <= 0x1F (unsigned)
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1F)), x);
+        // Non-ASCII bytes have the most significant bit set.
+        uint32_t m = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, bslash), ctl)) |
+                     _mm_movemask_epi8(x);
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+    }
+#endif
+    for (; p != end; ++p) {
+        if (is_str_special(*p)) {
+            break;
+        }
+    }
+    return p;
+}
+
+// Validates the UTF-8 sequence at 'p' (a non-ASCII byte). Returns the pointer past it, or NULL.
+static inline const char *validate_utf8_seq(const char *p, const char *end)
+{
+    const unsigned char *s = (const unsigned char *) p;
+    unsigned c = s[0];
+    // The range of the second byte; the rest are always 0x80...0xBF.
+    unsigned lo = 0x80;
+    unsigned hi = 0xBF;
+    size_t n;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 1;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 2;
+        if (c == 0xE0) {
+            // Overlong.
+            lo = 0xA0;
+        } else if (c == 0xED) {
+            // Surrogates.
+            hi = 0x9F;
+        }
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 3;
+        if (c == 0xF0) {
+            // Overlong.
+            lo = 0x90;
+        } else if (c == 0xF4) {
+            // Past U+10FFFF.
+            hi = 0x8F;
+        }
+    } else {
+        return NULL;
+    }
+    if ((size_t) (end - p) <= n)
+        return NULL;
+    if (s[1] < lo || s[1] > hi)
+        return NULL;
+    for (size_t i = 2; i <= n; ++i) {
+        if ((s[i] & 0xC0) != 0x80)
+            return NULL;
+    }
+    return p + n + 1;
+}
+
+// Validates the run of non-ASCII text at 'p' (a non-ASCII byte). Returns the pointer past it, or
+// NULL.
+static const char *validate_utf8_run_scalar(const char *p, const char *end)
+{
+    do {
+        p = validate_utf8_seq(p, end);
+    } while (p && p != end && ((unsigned char) *p) >= 0x80);
+    return p;
+}
+
+// The AVX2 implementation (below) may also validate any ASCII text following the run, up to a
+// byte for which 'is_str_special()' holds.
+static const char *(*validate_utf8_run)(const char *p, const char *end) = validate_utf8_run_scalar;
+
+static inline bool is_hex(char c)
+{
+    return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+// Validates the escape at 'p' (a backslash). Returns the pointer past it, or NULL.
+static inline const char *validate_esc(const char *p, const char *end)
+{
+    if (end - p < 2)
+        return NULL;
+    switch (p[1]) {
+    case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+        return p + 2;
+    case 'u':
+        if (end - p < 6)
+            return NULL;
+        if (!is_hex(p[2]) || !is_hex(p[3]) || !is_hex(p[4]) || !is_hex(p[5]))
+            return NULL;
+        return p + 6;
+    default:
+        return NULL;
+    }
+}
+
+static inline const char *validate_str_rest(const char *p, const char *end)
+{
+    for (;;) {
+        p = find_str_special(p, end);
+        if (unlikely(p == end))
+            return NULL;
+        unsigned char c = *p;
+        if (c == '"')
+            return p + 1;
+        if (c == '\\') {
+            p = validate_esc(p, end);
+        } else if (c < 0x20) {
+            return NULL;
+        } else {
+            // Non-ASCII text tends to come in runs; validate the whole run here.
+            p = validate_utf8_run(p, end);
+        }
+        if (unlikely(!p))
+            return NULL;
+    }
+}
+
+const char *json_validate_str_rest(const char *buf, const char *buf_end)
+{
+    return validate_str_rest(buf, buf_end);
+}
+
+static inline const char *validate_num(const char *p, const char *end)
+{
+    if (*p == '-') {
+        ++p;
+        if (p == end)
+            return NULL;
+    }
+    if (*p == '0') {
+        ++p;
+    } else if (*p >= '1' && *p <= '9') {
+        p = skip_digits(p + 1, end);
+    } else {
+        return NULL;
+    }
+
+    if (p != end && *p == '.') {
+        ++p;
+        if (p == end || !is_digit(*p))
+            return NULL;
+        p = skip_digits(p + 1, end);
+    }
+
+    if (p != end && (*p | 0x20) == 'e') {
+        ++p;
+        if (p != end && (*p == '+' || *p == '-'))
+            ++p;
+        if (p == end || !is_digit(*p))
+            return NULL;
+        p = skip_digits(p + 1, end);
+    }
+    return p;
+}
+
+static inline const char *validate_lit(const char *p, const char *end, const char *lit, size_t nlit)
+{
+    if ((size_t) (end - p) < nlit || memcmp(p, lit, nlit) != 0)
+        return NULL;
+    return p + nlit;
+}
+
+#if JSON_VALIDATE_X86
+
+// UTF-8 is checked 32 bytes at a time with the lookup algorithm of Keiser and Lemire ("Validating
+// UTF-8 in less than one instruction per byte", 2021): the high and the low nibble of each byte and
+// the high nibble of the next one index three tables of error classes, which are ANDed.
+
+# define AVX2_TARGET __attribute__((target("avx2")))
+
+// A table of 16 bytes for '_mm256_shuffle_epi8()', the same in both lanes.
+# define LUT16(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+
+// The bytes of 'In_' shifted by 'N_' positions, with the last ones of 'Prev_' shifted in.
+# define SHIFT_IN(In_, Prev_, N_) \
+    _mm256_alignr_epi8((In_), _mm256_permute2x128_si256((Prev_), (In_), 0x21), 16 - (N_))
+
+// Error classes of pairs of bytes, as (first, second).
+enum {
+    // A lead byte or ASCII followed by a lead byte or ASCII, where a continuation is expected.
+    TOO_SHORT = 1 << 0,
+    // ASCII followed by a continuation.
+    TOO_LONG = 1 << 1,
+    // 11100000 100_____
+    OVERLONG_3 = 1 << 2,
+    // Past U+10FFFF: 11110100 1001____, 11110100 101_____, 111101__ 10______ and so on.
+    TOO_LARGE = 1 << 3,
+    // 11101101 101_____
+    SURROGATE = 1 << 4,
+    // 1100000_ 10______
+    OVERLONG_2 = 1 << 5,
+    // Past U+10FFFF with 1000____ in the second byte; 11110000 1000____ is an overlong form.
+    TOO_LARGE_1000 = 1 << 6,
+    OVERLONG_4 = 1 << 6,
+    // Two continuations (0x80 as a signed char); expected after a lead byte of three or four.
+    TWO_CONTS = -0x80,
+
+    // The classes that do not depend on the low nibble of the first byte.
+    CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+};
+
+// Returns non-zero bytes at the positions of 'in' where UTF-8 is malformed; 'prev_in' are the 32
+// bytes before 'in'.
+AVX2_TARGET
+static inline __m256i utf8_errors(__m256i in, __m256i prev_in)
+{
+    __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = SHIFT_IN(in, prev_in, 1);
+
+    __m256i byte_1_high = _mm256_shuffle_epi8(
+        LUT16(
+            // 0_______ (ASCII)
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            // 10______ (continuation)
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            // 1100____
+            TOO_SHORT | OVERLONG_2,
+            // 1101____
+            TOO_SHORT,
+            // 1110____
+            TOO_SHORT | OVERLONG_3 | SURROGATE,
+            // 1111____
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4),
+        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+
+    __m256i byte_1_low = _mm256_shuffle_epi8(
+        LUT16(
+            // ____0000
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+            // ____0001
+            CARRY | OVERLONG_2,
+            // ____001_
+            CARRY,
+            CARRY,
+            // ____0100
+            CARRY | TOO_LARGE,
+            // ____0101, ____011_, ____1___
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            // ____1101
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000),
+        _mm256_and_si256(prev1, nibble));
+
+    __m256i byte_2_high = _mm256_shuffle_epi8(
+        LUT16(
+            // 0_______ (ASCII)
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            // 1000____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            // 1001____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            // 101_____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            // 11______ (lead)
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT),
+        _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble));
+
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Two continuations in a row are an error unless they follow a lead byte of three or four;
+    // and after such a lead byte, they are required. Only 111_____ and 1111____ keep the most
+    // significant bit after the saturating subtractions.
+    __m256i prev2 = SHIFT_IN(in, prev_in, 2);
+    __m256i prev3 = SHIFT_IN(in, prev_in, 3);
+    __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must_be_cont = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                                            _mm256_set1_epi8(TWO_CONTS));
+    return _mm256_xor_si256(must_be_cont, special);
+}
+
+// Like 'validate_utf8_run_scalar()'; returns at the first quote, backslash or control byte, or past
+// the first 32 bytes that are all ASCII.
+AVX2_TARGET
+static const char *validate_utf8_run_avx2(const char *p, const char *end)
+{
+    __m256i lane = _mm256_setr_epi8(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    __m256i prev = _mm256_setzero_si256();
+
+    for (;;) {
+        size_t n = end - p;
+        __m256i in;
+        if (likely(n >= 32)) {
+            in = _mm256_loadu_si256((const __m256i *) p);
+        } else {
+            // Zero bytes are control bytes, so the run stops at 'end' at the latest.
+            char tail[32] = {0};
+            memcpy(tail, p, n);
+            in = _mm256_loadu_si256((const __m256i *) tail);
+        }
+
+        __m256i quote = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('"'));
+        __m256i bslash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\\'));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(in, _mm256_set1_epi8(0x1F)), in);
+        uint32_t stop = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(quote, bslash), ctl));
+        if (stop) {
+            // Only the bytes before the stop belong to the run. The rest are zeroed, so that a
+            // sequence cut short by the stop is reported.
+            in = _mm256_and_si256(in, _mm256_cmpgt_epi8(_mm256_set1_epi8(__builtin_ctz(stop)), lane));
+        }
+        __m256i err = utf8_errors(in, prev);
+        if (unlikely(!_mm256_testz_si256(err, err)))
+            return NULL;
+        if (stop)
+            return p + __builtin_ctz(stop);
+
+        p += 32;
+        // Leave runs of ASCII to 'find_str_special()'.
+        if (!_mm256_movemask_epi8(in))
+            return p;
+        prev = in;
+    }
+}
+
+# undef SHIFT_IN
+# undef LUT16
+# undef AVX2_TARGET
+
+#endif
+
+const char *json_validate_value(const char *p, const char *end)
+{
+    // Bit 'i' is set iff the container at depth 'i' is a dict.
+    uint64_t is_dict[JSON_VALIDATE_MAX_DEPTH / 64];
+    size_t depth = 0;
+
+value:
+    if (unlikely(p == end))
+        return NULL;
+    switch (*p) {
+    case '{':
+    case '[':
+        {
+            if (unlikely(depth == JSON_VALIDATE_MAX_DEPTH))
+                return NULL;
+            uint64_t bit = 1ull << (depth % 64);
+            if (*p == '{') {
+                is_dict[depth / 64] |= bit;
+            } else {
+                is_dict[depth / 64] &= ~bit;
+            }
+            ++depth;
+            // ']' == '[' + 2 and '}' == '{' + 2.
+            char close = *p + 2;
+            p = skip_ws(p + 1, end);
+            if (unlikely(p == end))
+                return NULL;
+            if (*p == close) {
+                ++p;
+                --depth;
+                goto after_value;
+            }
+            if (close == '}')
+                goto key;
+            goto value;
+        }
+    case '"':
+        p = validate_str_rest(p + 1, end);
+        break;
+    case 't':
+        p = validate_lit(p, end, "true", 4);
+        break;
+    case 'f':
+        p = validate_lit(p, end, "false", 5);
+        break;
+    case 'n':
+        p = validate_lit(p, end, "null", 4);
+        break;
+    default:
+        p = validate_num(p, end);
+        break;
+    }
+    if (unlikely(!p))
+        return NULL;
+
+after_value:
+    if (depth == 0)
+        return p;
+    p = skip_ws(p, end);
+    if (unlikely(p == end))
+        return NULL;
+    {
+        bool in_dict = (is_dict[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1;
+        if (*p == ',') {
+            p = skip_ws(p + 1, end);
+            if (in_dict)
+                goto key;
+            goto value;
+        }
+        if (unlikely(*p != (in_dict ? '}' : ']')))
+            return NULL;
+        ++p;
+        --depth;
+        goto after_value;
+    }
+
+key:
+    if (unlikely(p == end || *p != '"'))
+        return NULL;
+    p = validate_str_rest(p + 1, end);
+    if (unlikely(!p))
+        return NULL;
+    p = skip_ws(p, end);
+    if (unlikely(p == end || *p != ':'))
+        return NULL;
+    p = skip_ws(p + 1, end);
+    goto value;
+}
+
+bool json_validate(const char *buf, const char *buf_end)
+{
+    buf = skip_ws(buf, buf_end);
+    buf = json_validate_value(buf, buf_end);
+    if (!buf)
+        return false;
+    return skip_ws(buf, buf_end) == buf_end;
+}
+
+bool json_validate_select(int which)
+{
+    const char *(*run)(const char *, const char *) = NULL;
+
+    switch (which) {
+    case JSON_VALIDATE_IMPL_SCALAR:
+        run = validate_utf8_run_scalar;
+        break;
+#if JSON_VALIDATE_X86
+    case JSON_VALIDATE_IMPL_AVX2:
+        if (__builtin_cpu_supports("avx2")) {
+            run = validate_utf8_run_avx2;
+        }
+        break;
+#endif
+    case JSON_VALIDATE_IMPL_AUTO:
+        return json_validate_select(JSON_VALIDATE_IMPL_AVX2)
+            || json_validate_select(JSON_VALIDATE_IMPL_SCALAR);
+    }
+
+    if (!run) {
+        return false;
+    }
+    validate_utf8_run = run;
+    return true;
+}
+
+__attribute__((constructor))
+static void json_validate_init(void)
+{
+    __builtin_cpu_init();
+    json_validate_select(JSON_VALIDATE_IMPL_AUTO);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+
+// Strict validation of JSON: the grammar of RFC 8259, including numbers and literals, and well-
+// formed UTF-8 (no overlong forms, surrogates or code points past U+10FFFF) in strings.
+//
+// These are the building blocks of the validating build of 'json_visit' (see
+// 'json_visit_validate.h'), which uses them in place of the bracket-balancing skips, so that
+// whatever the parser passes over is validated in the same pass.
+
+// This is a strict mode, not a drop-in replacement for the skips at the same speed: every byte of
+// the value is checked, so the cost grows with the number of tokens and structural bytes, while
+// the skips only look at brackets and quotes. Digits are checked 8 at a time and non-ASCII text,
+// on x86-64 CPUs with AVX2, 32 bytes at a time; the best implementation supported by the CPU is
+// selected at startup, see 'json_validate_select()'. All of them accept exactly the same inputs.
+
+// The maximum nesting depth of arrays and dicts accepted.
+#define JSON_VALIDATE_MAX_DEPTH 1024
+
+// Validates the value at {buf ... buf_end} (which must not start with whitespace). Returns the
+// pointer past it, or NULL if it is invalid.
+const char *json_validate_value(const char *buf, const char *buf_end);
+
+// Validates the rest of a string; 'buf' points past the opening quote. Returns the pointer past
+// the closing quote, or NULL if it is invalid.
+const char *json_validate_str_rest(const char *buf, const char *buf_end);
+
+// Checks if {buf ... buf_end} is a single valid JSON value, optionally surrounded by whitespace.
+bool json_validate(const char *buf, const char *buf_end);
+
+enum {
+    JSON_VALIDATE_IMPL_AUTO,
+    JSON_VALIDATE_IMPL_SCALAR,
+    JSON_VALIDATE_IMPL_AVX2,
+};
+
+// Selects the implementation (one of the JSON_VALIDATE_IMPL_* constants; JSON_VALIDATE_IMPL_AUTO
+// selects the best one supported by the CPU). Returns false (and leaves the current selection
+// unchanged) if the implementation is not supported either by the CPU or by this build.
+//
+// This is not thread-safe; it is meant to be called at startup or from tests and benchmarks.
+bool json_validate_select(int which);
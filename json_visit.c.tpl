@@ -1,3 +1,11 @@
+// In the validating build ('JSON_VALIDATING'), the values the parser skips over are validated
+// with 'json_validate_*()' instead of being merely balanced, the functions that would stop
+// before the end of a container (early exit, enough array elements) go on until its end, and
+// nothing but whitespace may follow the outermost container.
+#ifndef JSON_VALIDATING
+# define JSON_VALIDATING 0
+#endif
+
 #if JSON_PREEMPTIBLE
 # include "preempt.h"
 # define PREEMPT_DECLF(QualAndRettype_, Name_, ...)     QualAndRettype_ PREEMPT_ ## Name_(__VA_ARGS__, __attribute__((unused)) PreemptDevice *__preempt)
@@ -6,13 +14,37 @@
 # define PREEMPT_DECR(X_)                               (preempt_maybe_yield(__preempt), --(X_))
 # define PREEMPT_CALL(F_, ...)                          PREEMPT_ ## F_(__VA_ARGS__, __preempt)
 # define PREEMPT_CALL_V(F_, ...)                        PREEMPT_ ## F_(__preempt)
+// Long runs of bytes are processed in blocks of at most PREEMPT_BLOCK bytes, each with the same
+// routine as in the non-preemptible build; the allowance is then charged once per block.
+# define PREEMPT_BLOCK                                  1024
+# define PREEMPT_BLOCK_LEN(N_)                          ((N_) < PREEMPT_BLOCK ? (N_) : PREEMPT_BLOCK)
+# define PREEMPT_CHARGE(N_)                             preempt_maybe_yield_n(__preempt, (N_))
 #else
-# define PREEMPT_DECLF(QualAndRettype_, Name_, ...)     QualAndRettype_ Name_(__VA_ARGS__)
-# define PREEMPT_DECLF_V(QualAndRettype_, Name_, ...)   QualAndRettype_ Name_(void)
+// The validating build prefixes the names with 'VALIDATE_'.
+# if JSON_VALIDATING
+#  define JSON_VISIT_NAME(Name_)                        VALIDATE_ ## Name_
+# else
+#  define JSON_VISIT_NAME(Name_)                        Name_
+# endif
+# define PREEMPT_DECLF(QualAndRettype_, Name_, ...)     QualAndRettype_ JSON_VISIT_NAME(Name_)(__VA_ARGS__)
+# define PREEMPT_DECLF_V(QualAndRettype_, Name_, ...)   QualAndRettype_ JSON_VISIT_NAME(Name_)(void)
 # define PREEMPT_INCR(X_)                               (++(X_))
 # define PREEMPT_DECR(X_)                               (--(X_))
-# define PREEMPT_CALL(F_, ...)                          F_(__VA_ARGS__)
-# define PREEMPT_CALL_V(F_, ...)                        F_()
+# define PREEMPT_CALL(F_, ...)                          JSON_VISIT_NAME(F_)(__VA_ARGS__)
+# define PREEMPT_CALL_V(F_, ...)                        JSON_VISIT_NAME(F_)()
+# define PREEMPT_BLOCK_LEN(N_)                          (N_)
+# define PREEMPT_CHARGE(N_)                             ((void) 0)
+#endif
+
+#include "json_parse_num.h"
+#include "json_scan.h"
+#include "json_stats.h"
+
+#if JSON_VALIDATING
+# if JSON_PREEMPTIBLE
+#  error "the validating build is not preemptible"
+# endif
+# include "json_validate.h"
 #endif
 
 // The "main table" contains flags and classes for all of the 256 symbols.
@@ -77,10 +109,21 @@ PREEMPT_DECLF(
         const char *s,
         const char *s_end)
 {
-    while (s != s_end && (MAIN_TABLE[(unsigned char) *s] & FLAG_WHITESPACE)) {
-        PREEMPT_INCR(s);
+    // Most of the time there is either no whitespace at all or a single space, so check the first
+    // two bytes before falling back to the block kernel.
+    if (s == s_end || !(MAIN_TABLE[(unsigned char) *s] & FLAG_WHITESPACE))
+        return s;
+    PREEMPT_INCR(s);
+    if (s == s_end || !(MAIN_TABLE[(unsigned char) *s] & FLAG_WHITESPACE))
+        return s;
+    for (;;) {
+        const char *block_end = s + PREEMPT_BLOCK_LEN((size_t) (s_end - s));
+        const char *r = json_scan_skip_ws(s, block_end);
+        PREEMPT_CHARGE(r - s);
+        if (r != block_end || block_end == s_end)
+            return r;
+        s = block_end;
     }
-    return s;
 }
 
 PREEMPT_DECLF(
@@ -113,40 +156,23 @@ PREEMPT_DECLF(
 {
     PREEMPT_INCR(buf);
 
+#if JSON_VALIDATING
+    return json_validate_str_rest(buf, buf_end);
+#else
+    JsonScanState st = json_scan_state_new();
     for (;;) {
-
-        // Find the next '"'. If none, return NULL.
-
-#if JSON_PREEMPTIBLE
-        for (;;) {
-            if (unlikely(buf == buf_end))
-                return NULL;
-            if (*buf == '"')
-                break;
-
-            PREEMPT_INCR(buf);
+        const char *block_end = buf + PREEMPT_BLOCK_LEN((size_t) (buf_end - buf));
+        const char *r = json_scan_skip_str(&st, buf, block_end);
+        if (r) {
+            PREEMPT_CHARGE(r - buf);
+            return r;
         }
-#else
-        if (unlikely(buf == buf_end))
-            return NULL;
-        buf = memchr(buf, '"', buf_end - buf);
-        if (unlikely(!buf))
+        PREEMPT_CHARGE(block_end - buf);
+        if (block_end == buf_end)
             return NULL;
-#endif
-
-        // Check if it is escaped. If not, return buf+1. Otherwise, do ++buf and repeat.
-
-        ssize_t offset = -1;
-        while (buf[offset] == '\\') {
-            PREEMPT_DECR(offset);
-        }
-
-        PREEMPT_INCR(buf);
-        if (likely(offset & 1)) {
-            // The number of backslashes before '"' is even, so it is not escaped.
-            return buf;
-        }
+        buf = block_end;
     }
+#endif
 }
 
 // Skip a string. Checks that (buf != buf_end && buf[0] == '"')
@@ -173,32 +199,24 @@ PREEMPT_DECLF(
     if (unlikely(buf == buf_end))
         return NULL;
 
+#if JSON_VALIDATING
+    return json_validate_value(buf, buf_end);
+#else
     char x = *buf;
     if ((x & 0xDF) == 0x5B) {
         // x is either '[' or '{'
-        static const int8_t table[256] = {
-            ['['] = 1,
-            ['{'] = 1,
-            [']'] = -1,
-            ['}'] = -1,
-        };
-        size_t level = 1;
-        PREEMPT_INCR(buf);
+        JsonScanState st = json_scan_state_new();
         for (;;) {
-            if (unlikely(buf == buf_end))
-                return NULL;
-            char y = *buf;
-            if (y == '"') {
-                buf = PREEMPT_CALL(skip_str_unchecked, buf, buf_end);
-                if (unlikely(!buf))
-                    return NULL;
-            } else {
-                level += table[(unsigned char) y];
-                if (level == 0) {
-                    return buf + 1;
-                }
-                PREEMPT_INCR(buf);
+            const char *block_end = buf + PREEMPT_BLOCK_LEN((size_t) (buf_end - buf));
+            const char *r = json_scan_skip_nested(&st, buf, block_end);
+            if (r) {
+                PREEMPT_CHARGE(r - buf);
+                return r;
             }
+            PREEMPT_CHARGE(block_end - buf);
+            if (block_end == buf_end)
+                return NULL;
+            buf = block_end;
         }
 
     } else if (x == '"') {
@@ -211,6 +229,25 @@ PREEMPT_DECLF(
         } while (buf != buf_end && (MAIN_TABLE[(unsigned char) *buf] & FLAG_TOKEN));
         return buf;
     }
+#endif
+}
+
+// Called past the closing bracket of a container; returns 0, or, in the validating build, -1
+// if anything but whitespace follows.
+PREEMPT_DECLF(
+    static inline int,
+    check_trailing,
+        const char *buf,
+        const char *buf_end)
+{
+#if JSON_VALIDATING
+    if (unlikely(PREEMPT_CALL(skip_whitespace, buf, buf_end) != buf_end))
+        return -1;
+#else
+    (void) buf;
+    (void) buf_end;
+#endif
+    return 0;
 }
 
 PREEMPT_DECLF(
@@ -234,7 +271,7 @@ PREEMPT_DECLF(
             return -1;
         }
         if (a.begin[0] == ']') {
-            return 0;
+            return PREEMPT_CALL(check_trailing, a.begin + 1, a.end);
         }
 
     } else {
@@ -246,7 +283,7 @@ PREEMPT_DECLF(
         }
         char c = a.begin[0];
         if (c == ']') {
-            return 0;
+            return PREEMPT_CALL(check_trailing, a.begin + 1, a.end);
         }
         if (unlikely(c != ',')) {
             return -1;
@@ -261,6 +298,7 @@ PREEMPT_DECLF(
         return -1;
     }
     e->end = a.begin;
+    JSON_STATS_ADD(array_steps, 1);
     return 1;
 }
 
@@ -286,7 +324,7 @@ PREEMPT_DECLF(
             return -1;
         }
         if (d.begin[0] == '}') {
-            return 0;
+            return PREEMPT_CALL(check_trailing, d.begin + 1, d.end);
         }
 
     } else {
@@ -298,7 +336,7 @@ PREEMPT_DECLF(
         }
         char c = d.begin[0];
         if (c == '}') {
-            return 0;
+            return PREEMPT_CALL(check_trailing, d.begin + 1, d.end);
         }
         if (unlikely(c != ',')) {
             return -1;
@@ -333,26 +371,12 @@ PREEMPT_DECLF(
         return -1;
     }
     v->end = d.begin;
+    JSON_STATS_ADD(dict_steps, 1);
     return 1;
 }
 
-PREEMPT_DECLF(
-    static inline bool,
-    span_eq,
-        const char *a,
-        const char *b,
-        size_t n)
+static inline bool span_eq_block(const char *a, const char *b, size_t n)
 {
-#if JSON_PREEMPTIBLE
-    size_t i = 0;
-    while (i < n) {
-        if (a[i] != b[i]) {
-            return false;
-        }
-        PREEMPT_INCR(i);
-    }
-    return true;
-#else
     // Check a few starting characters, then call memcmp().
     if (!n)
         return true;
@@ -368,7 +392,44 @@ PREEMPT_DECLF(
         return true;
 
     return memcmp(a + 2, b + 2, n - 2) == 0;
-#endif
+}
+
+PREEMPT_DECLF(
+    static inline bool,
+    span_eq,
+        const char *a,
+        const char *b,
+        size_t n)
+{
+    for (;;) {
+        size_t m = PREEMPT_BLOCK_LEN(n);
+        if (!span_eq_block(a, b, m))
+            return false;
+        PREEMPT_CHARGE(m);
+        if (m == n)
+            return true;
+        a += m;
+        b += m;
+        n -= m;
+    }
+}
+
+PREEMPT_DECLF(
+        static inline const char *,
+        find_next_escape,
+            const char *buf, const char *buf_end)
+{
+    while (buf != buf_end) {
+        size_t m = PREEMPT_BLOCK_LEN((size_t) (buf_end - buf));
+        const char *r = memchr(buf, '\\', m);
+        if (r) {
+            PREEMPT_CHARGE(r - buf);
+            return r;
+        }
+        PREEMPT_CHARGE(m);
+        buf += m;
+    }
+    return buf_end;
 }
 
 PREEMPT_DECLF(
@@ -379,6 +440,7 @@ PREEMPT_DECLF(
         JsonFieldEntry *entries,
         int nentries)
 {
+    JSON_STATS_CALL(buf, buf_end);
     JsonSpan d = {buf, buf_end};
     JsonSpan k = {0};
     JsonSpan v = {0};
@@ -391,6 +453,7 @@ PREEMPT_DECLF(
             if (nk == e->nkey && PREEMPT_CALL(span_eq, e->key, k.begin + 1, nk)) {
                 e->v_begin = v.begin;
                 e->v_end = v.end;
+                JSON_STATS_ADD(bytes_matched, v.end - v.begin);
                 break;
             }
         }
@@ -398,6 +461,90 @@ PREEMPT_DECLF(
     return r;
 }
 
+// Returns the entry matched by the key {k ... k+nk} (without quotes) according to 'kd' ("sloppy"
+// match), or NULL if there is none.
+PREEMPT_DECLF(
+    static inline JsonFieldEntry *,
+    kd_match,
+        const JsonKeyDispatch *kd,
+        JsonFieldEntry *entries,
+        int nentries,
+        const char *k,
+        size_t nk)
+{
+    if (kd->table) {
+        if (nk < kd->min_len || nk > kd->max_len)
+            return NULL;
+        ssize_t p0 = kd->pos[0] >= 0 ? kd->pos[0] : (ssize_t) nk + kd->pos[0];
+        ssize_t p1 = kd->pos[1] >= 0 ? kd->pos[1] : (ssize_t) nk + kd->pos[1];
+        uint32_t c0 = (unsigned char) k[p0];
+        uint32_t c1 = (unsigned char) k[p1];
+        uint32_t h = ((uint32_t) nk | (c0 << 8) | (c1 << 16)) * kd->mult;
+        uint8_t i = kd->table[h >> kd->shift];
+        if (i == 0xFF)
+            return NULL;
+        JsonFieldEntry *e = &entries[i];
+        if (nk == e->nkey && PREEMPT_CALL(span_eq, e->key, k, nk))
+            return e;
+        return NULL;
+    }
+
+    JsonFieldEntry *entries_end = entries + nentries;
+    for (JsonFieldEntry *e = entries; e != entries_end; ++e) {
+        if (nk == e->nkey && PREEMPT_CALL(span_eq, e->key, k, nk))
+            return e;
+    }
+    return NULL;
+}
+
+enum { KEY_SCRATCH_SIZE = 256 };
+
+// Finds the entry matched by the key 'k' (exact match), writing it (or NULL if there is none) into
+// '*out'. Returns 0 on success, -1 on error.
+//
+// A key without escapes is looked up as is, and a key with escapes is unescaped once and then
+// looked up; either way, 'kd' is consulted once instead of unescaping the key for each entry.
+PREEMPT_DECLF(
+    static inline int,
+    kd_match_exact,
+        const JsonKeyDispatch *kd,
+        JsonFieldEntry *entries,
+        int nentries,
+        JsonSpan k,
+        JsonFieldEntry **out)
+{
+    const char *kb = k.begin + 1;
+    const char *ke = k.end - 1;
+    if (likely(PREEMPT_CALL(find_next_escape, kb, ke) == ke)) {
+        *out = PREEMPT_CALL(kd_match, kd, entries, nentries, kb, ke - kb);
+        return 0;
+    }
+
+    // The unescaped key is not longer than the escaped one.
+    if (likely(ke - kb <= KEY_SCRATCH_SIZE)) {
+        char scratch[KEY_SCRATCH_SIZE];
+        ssize_t n = PREEMPT_CALL(json_unesc, k.begin, k.end, scratch);
+        if (unlikely(n < 0))
+            return -1;
+        *out = PREEMPT_CALL(kd_match, kd, entries, nentries, scratch, n);
+        return 0;
+    }
+
+    // A long key with escapes: compare it with each entry in turn.
+    JsonFieldEntry *entries_end = entries + nentries;
+    for (JsonFieldEntry *e = entries; e != entries_end; ++e) {
+        int r = PREEMPT_CALL(json_streq_exact_b, k.begin, k.end, e->key, e->key + e->nkey);
+        if (r > 0) {
+            *out = e;
+            return 0;
+        } else if (r < 0) {
+            return -1;
+        }
+    }
+    *out = NULL;
+    return 0;
+}
+
 PREEMPT_DECLF(
     int,
     json_parse_dict_fields_exact,
@@ -406,25 +553,119 @@ PREEMPT_DECLF(
         JsonFieldEntry *entries,
         int nentries)
 {
+    // Without a table, 'kd_match()' scans the entries linearly.
+    static const JsonKeyDispatch kd = {0};
+
+    JSON_STATS_CALL(buf, buf_end);
     JsonSpan d = {buf, buf_end};
     JsonSpan k = {0};
     JsonSpan v = {0};
-    JsonFieldEntry *entries_end = entries + nentries;
     int r;
 
     while ((r = PREEMPT_CALL(json_dict_next, d, &k, &v)) > 0) {
-        for (JsonFieldEntry *e = entries; e != entries_end; ++e) {
-            int r2 = PREEMPT_CALL(json_streq_exact_b, k.begin, k.end, e->key, e->key + e->nkey);
-            if (r2 > 0) {
-                e->v_begin = v.begin;
-                e->v_end = v.end;
-                break;
-            } else if (r2 < 0) {
-                return -1;
-            }
+        JsonFieldEntry *e;
+        if (unlikely(PREEMPT_CALL(kd_match_exact, &kd, entries, nentries, k, &e) < 0)) {
+            return -1;
         }
+        if (e) {
+            e->v_begin = v.begin;
+            e->v_end = v.end;
+            JSON_STATS_ADD(bytes_matched, v.end - v.begin);
+        }
+    }
+    return r;
+}
+
+// Stores the value 'v' into the entry 'e'. Returns true if all the entries have been found and
+// the parsing should stop.
+static inline bool kd_store(const JsonKeyDispatch *kd, JsonFieldEntry *e, JsonSpan v, int *nleft)
+{
+    if (kd->flags & JSON_KD_EARLY_EXIT) {
+        if (e->v_begin)
+            return false;
+        e->v_begin = v.begin;
+        e->v_end = v.end;
+        JSON_STATS_ADD(bytes_matched, v.end - v.begin);
+        return --*nleft == 0;
+    }
+    e->v_begin = v.begin;
+    e->v_end = v.end;
+    JSON_STATS_ADD(bytes_matched, v.end - v.begin);
+    return false;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_parse_dict_fields_kd,
+        const char *buf,
+        const char *buf_end,
+        JsonFieldEntry *entries,
+        int nentries,
+        const JsonKeyDispatch *kd)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    JsonSpan d = {buf, buf_end};
+    JsonSpan k = {0};
+    JsonSpan v = {0};
+    int nleft = nentries;
+    int r;
+
+    while ((r = PREEMPT_CALL(json_dict_next, d, &k, &v)) > 0) {
+        JsonFieldEntry *e = PREEMPT_CALL(kd_match, kd, entries, nentries, k.begin + 1, k.end - k.begin - 2);
+        if (e && kd_store(kd, e, v, &nleft) && !JSON_VALIDATING) {
+            return 0;
+        }
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_parse_dict_fields_kd_exact,
+        const char *buf,
+        const char *buf_end,
+        JsonFieldEntry *entries,
+        int nentries,
+        const JsonKeyDispatch *kd)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    JsonSpan d = {buf, buf_end};
+    JsonSpan k = {0};
+    JsonSpan v = {0};
+    int nleft = nentries;
+    int r;
+
+    while ((r = PREEMPT_CALL(json_dict_next, d, &k, &v)) > 0) {
+        JsonFieldEntry *e;
+        if (unlikely(PREEMPT_CALL(kd_match_exact, kd, entries, nentries, k, &e) < 0)) {
+            return -1;
+        }
+        if (e && kd_store(kd, e, v, &nleft) && !JSON_VALIDATING) {
+            return 0;
+        }
+    }
+    return r;
+}
+
+// Called once all the wanted elements of the array 'a' have been found, 'v' being the last one
+// visited. Returns 0, or, in the validating build, goes on until the end of the array and returns
+// -1 if it is invalid.
+PREEMPT_DECLF(
+    static inline int,
+    finish_array,
+        JsonSpan a,
+        JsonSpan *v)
+{
+#if JSON_VALIDATING
+    int r;
+    while ((r = PREEMPT_CALL(json_array_next, a, v)) > 0) {
     }
     return r;
+#else
+    (void) a;
+    (void) v;
+    return 0;
+#endif
 }
 
 PREEMPT_DECLF(
@@ -435,6 +676,7 @@ PREEMPT_DECLF(
         JsonElemEntry *entries,
         int nentries)
 {
+    JSON_STATS_CALL(buf, buf_end);
     if (unlikely(!nentries))
         return 0;
 
@@ -444,8 +686,9 @@ PREEMPT_DECLF(
     int r;
     while ((r = PREEMPT_CALL(json_array_next, a, &v)) > 0) {
         *entries++ = (JsonElemEntry) {v.begin, v.end};
+        JSON_STATS_ADD(bytes_matched, v.end - v.begin);
         if (entries == entries_end) {
-            return 0;
+            return PREEMPT_CALL(finish_array, a, &v);
         }
     }
     return r;
@@ -459,6 +702,7 @@ PREEMPT_DECLF(
         JsonSparseElemEntry *entries,
         int nentries)
 {
+    JSON_STATS_CALL(buf, buf_end);
     if (unlikely(!nentries))
         return 0;
 
@@ -472,9 +716,10 @@ PREEMPT_DECLF(
             if (entries->i == i) {
                 entries->v_begin = v.begin;
                 entries->v_end = v.end;
+                JSON_STATS_ADD(bytes_matched, v.end - v.begin);
                 ++entries;
                 if (entries == entries_end) {
-                    return 0;
+                    return PREEMPT_CALL(finish_array, a, &v);
                 }
             } else {
                 break;
@@ -485,72 +730,814 @@ PREEMPT_DECLF(
     return r;
 }
 
+// Skips the rest of an array or a dict, 'buf' pointing past its opening bracket or past one of its
+// values.
 PREEMPT_DECLF(
-    bool,
-    json_streq,
+    static const char *,
+    skip_rest,
         const char *buf,
-        const char *buf_end,
-        const char *s)
+        const char *buf_end)
 {
-    size_t nbuf = buf_end - buf;
-    if (nbuf < 2)
-        return false;
-    if (buf[0] != '"')
-        return false;
+    JsonScanState st = json_scan_state_new();
+    st.depth = 1;
+    for (;;) {
+        const char *block_end = buf + PREEMPT_BLOCK_LEN((size_t) (buf_end - buf));
+        const char *r = json_scan_skip_nested(&st, buf, block_end);
+        if (r) {
+            PREEMPT_CHARGE(r - buf);
+            return r;
+        }
+        PREEMPT_CHARGE(block_end - buf);
+        if (block_end == buf_end)
+            return NULL;
+        buf = block_end;
+    }
+}
 
-    size_t n = nbuf - 2;
-    size_t i = 0;
-    while (i < n) {
-        char c = s[i];
-        if (c == '\0')
-            return false;
-        if (buf[i + 1] != c)
-            return false;
-        PREEMPT_INCR(i);
+static inline JsonSpan plan_get(const JsonPlan *plan, int i)
+{
+    switch (plan->kind) {
+    case JSON_PLAN_DICT:
+    case JSON_PLAN_DICT_EXACT:
+        return json_span_from_fentry(plan->fields[i]);
+    case JSON_PLAN_ARRAY:
+        return json_span_from_eentry(plan->elems[i]);
+    default:
+        return json_span_from_seentry(plan->sparse_elems[i]);
     }
-    return buf_end[-1] == '"' && s[n] == '\0';
 }
 
-PREEMPT_DECLF(
-        static inline const char *,
-        find_next_escape,
-            const char *buf, const char *buf_end)
+static inline void plan_set(const JsonPlan *plan, int i, JsonSpan v)
 {
-#if JSON_PREEMPTIBLE
-    while (buf != buf_end) {
-        if (*buf == '\\') {
-            break;
+    switch (plan->kind) {
+    case JSON_PLAN_DICT:
+    case JSON_PLAN_DICT_EXACT:
+        plan->fields[i].v_begin = v.begin;
+        plan->fields[i].v_end = v.end;
+        break;
+    case JSON_PLAN_ARRAY:
+        plan->elems[i] = (JsonElemEntry) {v.begin, v.end};
+        break;
+    default:
+        plan->sparse_elems[i].v_begin = v.begin;
+        plan->sparse_elems[i].v_end = v.end;
+        break;
+    }
+}
+
+static inline const JsonPlan *plan_sub(const JsonPlan *plan, int i)
+{
+    return plan->sub ? plan->sub[i] : NULL;
+}
+
+// Empties the entries of 'plan' and of the nodes below it.
+static void plan_clear(const JsonPlan *plan)
+{
+    for (int i = 0; i < plan->nentries; ++i) {
+        plan_set(plan, i, (JsonSpan) {NULL, NULL});
+        const JsonPlan *sub = plan_sub(plan, i);
+        if (sub) {
+            plan_clear(sub);
         }
-        PREEMPT_INCR(buf);
     }
-    return buf;
-#else
-    if (buf != buf_end)
-        buf = memchr(buf, '\\', buf_end - buf);
-    return buf ? buf : buf_end;
-#endif
 }
 
-static inline int unesc_single(char c)
+// Returns true if the value of some entry of 'plan' that has a node of its own has not been found.
+static inline bool plan_missing_sub(const JsonPlan *plan)
 {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Woverride-init"
-    static const int8_t table[256] = {
-        [0 ... 255] = -1,
-        ['"'] = '"',
-        ['\\'] = '\\',
-        ['/'] = '/',
-        ['b'] = '\b',
-        ['f'] = '\f',
-        ['n'] = '\n',
-        ['r'] = '\r',
-        ['t'] = '\t',
-    };
-#pragma GCC diagnostic pop
-    return table[(unsigned char) c];
+    for (int i = 0; i < plan->nentries; ++i) {
+        if (plan_sub(plan, i) && !plan_get(plan, i).begin)
+            return true;
+    }
+    return false;
 }
 
-static int parse_hex_escape(const char *s)
+// Parses the value at 'buf' (which must not be whitespace) with the node 'plan'. Returns the end of
+// the value, or NULL on error; for the root node ('root'), it may also return 'buf_end' once
+// everything wanted has been found. The errors in the values of the nodes below only set '*bad'.
+PREEMPT_DECLF(
+    static const char *,
+    plan_parse_value,
+        const JsonPlan *plan,
+        const char *buf,
+        const char *buf_end,
+        bool root,
+        bool *bad);
+
+// Parses the value of entry 'i' of 'plan' at 'buf': with its own node if it has one, by skipping
+// it over otherwise. Stores its span into the entry and returns its end, or NULL on error.
+PREEMPT_DECLF(
+    static inline const char *,
+    plan_parse_entry,
+        const JsonPlan *plan,
+        int i,
+        const char *buf,
+        const char *buf_end,
+        bool *bad)
+{
+    const JsonPlan *sub = plan_sub(plan, i);
+    const char *r;
+    if (sub) {
+        if (plan_get(plan, i).begin) {
+            // Only the last occurrence counts.
+            plan_clear(sub);
+        }
+        r = PREEMPT_CALL(plan_parse_value, sub, buf, buf_end, false, bad);
+        if (unlikely(!r)) {
+            // Not what the node expects; the enclosing container may still be fine.
+            *bad = true;
+            r = PREEMPT_CALL(skip_obj, buf, buf_end);
+        }
+    } else {
+        r = PREEMPT_CALL(skip_obj, buf, buf_end);
+        if (unlikely(!r))
+            return NULL;
+        // Only the leaves count: the values descended into are made up of them.
+        JSON_STATS_ADD(bytes_matched, r - buf);
+    }
+    if (unlikely(!r))
+        return NULL;
+    plan_set(plan, i, (JsonSpan) {buf, r});
+    return r;
+}
+
+// Same as 'plan_parse_value()' for a dict, 'buf' pointing past the '{'.
+PREEMPT_DECLF(
+    static const char *,
+    plan_parse_dict,
+        const JsonPlan *plan,
+        const char *buf,
+        const char *buf_end,
+        bool root,
+        bool *bad)
+{
+    // Without a table, 'kd_match()' scans the entries linearly.
+    static const JsonKeyDispatch no_kd = {0};
+    const JsonKeyDispatch *kd = plan->kd ? plan->kd : &no_kd;
+    bool early_exit = (kd->flags & JSON_KD_EARLY_EXIT) && !JSON_VALIDATING;
+    int nleft = plan->nentries;
+
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    if (unlikely(buf == buf_end))
+        return NULL;
+    if (buf[0] == '}')
+        return buf + 1;
+
+    for (;;) {
+        JsonSpan k = {buf, NULL};
+        buf = PREEMPT_CALL(skip_str, buf, buf_end);
+        if (unlikely(!buf))
+            return NULL;
+        k.end = buf;
+
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        if (unlikely(buf == buf_end))
+            return NULL;
+        if (unlikely(buf[0] != ':'))
+            return NULL;
+        PREEMPT_INCR(buf);
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        if (unlikely(buf == buf_end))
+            return NULL;
+
+        JsonFieldEntry *e;
+        if (plan->kind == JSON_PLAN_DICT_EXACT) {
+            if (unlikely(PREEMPT_CALL(kd_match_exact, kd, plan->fields, plan->nentries, k, &e) < 0))
+                return NULL;
+        } else {
+            e = PREEMPT_CALL(kd_match, kd, plan->fields, plan->nentries, k.begin + 1, k.end - k.begin - 2);
+        }
+        JSON_STATS_ADD(dict_steps, 1);
+
+        if (e && !(early_exit && e->v_begin)) {
+            buf = PREEMPT_CALL(plan_parse_entry, plan, e - plan->fields, buf, buf_end, bad);
+            if (unlikely(!buf))
+                return NULL;
+            if (early_exit && --nleft == 0)
+                return root ? buf_end : PREEMPT_CALL(skip_rest, buf, buf_end);
+        } else {
+            buf = PREEMPT_CALL(skip_obj, buf, buf_end);
+            if (unlikely(!buf))
+                return NULL;
+        }
+
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        if (unlikely(buf == buf_end))
+            return NULL;
+        if (buf[0] == '}')
+            return buf + 1;
+        if (unlikely(buf[0] != ','))
+            return NULL;
+        PREEMPT_INCR(buf);
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    }
+}
+
+// Same as 'plan_parse_value()' for an array, 'buf' pointing past the '['.
+PREEMPT_DECLF(
+    static const char *,
+    plan_parse_array,
+        const JsonPlan *plan,
+        const char *buf,
+        const char *buf_end,
+        bool root,
+        bool *bad)
+{
+    bool sparse = plan->kind == JSON_PLAN_ARRAY_SPARSE;
+    // The first entry not filled yet.
+    int j = 0;
+
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    if (unlikely(buf == buf_end))
+        return NULL;
+    if (buf[0] == ']')
+        return buf + 1;
+
+    for (size_t i = 0;; ++i) {
+        if (j != plan->nentries && (sparse ? plan->sparse_elems[j].i == i : (size_t) j == i)) {
+            // A sparse index may be wanted by several entries; parse it with the one that has a
+            // node, if any, and copy the span into the others.
+            int k = j + 1;
+            int which = j;
+            if (sparse) {
+                for (; k != plan->nentries && plan->sparse_elems[k].i == i; ++k) {
+                    if (!plan_sub(plan, which) && plan_sub(plan, k)) {
+                        which = k;
+                    }
+                }
+            }
+            buf = PREEMPT_CALL(plan_parse_entry, plan, which, buf, buf_end, bad);
+            if (unlikely(!buf))
+                return NULL;
+            for (; j != k; ++j) {
+                plan_set(plan, j, plan_get(plan, which));
+            }
+            JSON_STATS_ADD(array_steps, 1);
+            if (j == plan->nentries && !JSON_VALIDATING)
+                return root ? buf_end : PREEMPT_CALL(skip_rest, buf, buf_end);
+        } else {
+            buf = PREEMPT_CALL(skip_obj, buf, buf_end);
+            if (unlikely(!buf))
+                return NULL;
+            JSON_STATS_ADD(array_steps, 1);
+        }
+
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        if (unlikely(buf == buf_end))
+            return NULL;
+        if (buf[0] == ']')
+            return buf + 1;
+        if (unlikely(buf[0] != ','))
+            return NULL;
+        PREEMPT_INCR(buf);
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    }
+}
+
+PREEMPT_DECLF(
+    static const char *,
+    plan_parse_value,
+        const JsonPlan *plan,
+        const char *buf,
+        const char *buf_end,
+        bool root,
+        bool *bad)
+{
+    if (unlikely(buf == buf_end))
+        return NULL;
+    bool dict = plan->kind == JSON_PLAN_DICT || plan->kind == JSON_PLAN_DICT_EXACT;
+    if (unlikely(buf[0] != (dict ? '{' : '[')))
+        return NULL;
+    PREEMPT_INCR(buf);
+
+    const char *r = dict
+        ? PREEMPT_CALL(plan_parse_dict, plan, buf, buf_end, root, bad)
+        : PREEMPT_CALL(plan_parse_array, plan, buf, buf_end, root, bad);
+    if (r && plan_missing_sub(plan)) {
+        *bad = true;
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_parse_plan,
+        const char *buf,
+        const char *buf_end,
+        const JsonPlan *plan)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    bool bad = false;
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    const char *r = PREEMPT_CALL(plan_parse_value, plan, buf, buf_end, true, &bad);
+    if (unlikely(!r))
+        return -1;
+    if (unlikely(PREEMPT_CALL(check_trailing, r, buf_end) < 0))
+        return -1;
+    return bad ? -1 : 0;
+}
+
+// Records 'cur->last', element 'i', as a mark if it falls on one.
+static inline void cursor_mark(JsonCursor *cur, size_t i)
+{
+    if (i % cur->every || i / cur->every != cur->nmarks)
+        return;
+    if (cur->nmarks == cur->capmarks) {
+        if (!cur->capmarks)
+            return;
+        for (size_t j = 0; 2 * j < cur->capmarks; ++j) {
+            cur->marks[j] = cur->marks[2 * j];
+        }
+        cur->nmarks = (cur->capmarks + 1) / 2;
+        cur->every *= 2;
+        if (i % cur->every || i / cur->every != cur->nmarks)
+            return;
+    }
+    cur->marks[cur->nmarks++] = cur->last;
+}
+
+// Moves the cursor to the next element.
+PREEMPT_DECLF(
+    static inline int,
+    cursor_step,
+        JsonCursor *cur,
+        bool dict)
+{
+    JsonCursorMark m = cur->last;
+    int r = dict
+        ? PREEMPT_CALL(json_dict_next, cur->c, &m.k, &m.v)
+        : PREEMPT_CALL(json_array_next, cur->c, &m.v);
+    if (r <= 0) {
+        if (r == 0)
+            cur->count = cur->next;
+        return r;
+    }
+    cur->last = m;
+    cursor_mark(cur, cur->next++);
+    return 1;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_cursor_array_next,
+        JsonCursor *cur,
+        JsonSpan *e)
+{
+    int r = PREEMPT_CALL(cursor_step, cur, false);
+    if (r > 0)
+        *e = cur->last.v;
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_cursor_dict_next,
+        JsonCursor *cur,
+        JsonSpan *k,
+        JsonSpan *v)
+{
+    int r = PREEMPT_CALL(cursor_step, cur, true);
+    if (r > 0) {
+        *k = cur->last.k;
+        *v = cur->last.v;
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_cursor_array_at,
+        JsonCursor *cur,
+        size_t i,
+        JsonSpan *e)
+{
+    if (i >= cur->count)
+        return 0;
+
+    // Resume from the nearest mark at or before 'i' unless the cursor is closer.
+    if (cur->nmarks) {
+        size_t j = i / cur->every;
+        if (j >= cur->nmarks)
+            j = cur->nmarks - 1;
+        size_t at = j * cur->every;
+        if (cur->next <= at || cur->next > i + 1) {
+            cur->last = cur->marks[j];
+            cur->next = at + 1;
+        }
+    } else if (cur->next > i + 1) {
+        json_cursor_rewind(cur);
+    }
+
+    while (cur->next <= i) {
+        int r = PREEMPT_CALL(cursor_step, cur, false);
+        if (r <= 0)
+            return r;
+        JSON_STATS_ADD(array_steps, 1);
+    }
+    *e = cur->last.v;
+    return 1;
+}
+
+PREEMPT_DECLF(
+    static inline int,
+    cursor_key_eq,
+        JsonSpan k,
+        const char *key,
+        size_t nkey,
+        bool exact)
+{
+    if (exact)
+        return PREEMPT_CALL(json_streq_exact_b, k.begin, k.end, key, key + nkey);
+    return (size_t) (k.end - k.begin - 2) == nkey && PREEMPT_CALL(span_eq, k.begin + 1, key, nkey);
+}
+
+PREEMPT_DECLF(
+    static int,
+    cursor_dict_get,
+        JsonCursor *cur,
+        const char *key,
+        JsonSpan *v,
+        bool exact)
+{
+    size_t nkey = strlen(key);
+    int r;
+    if (cur->next) {
+        r = PREEMPT_CALL(cursor_key_eq, cur->last.k, key, nkey, exact);
+        if (r)
+            goto found;
+    }
+
+    // From the cursor up to the end...
+    size_t start = cur->next;
+    for (;;) {
+        r = PREEMPT_CALL(cursor_step, cur, true);
+        if (r < 0)
+            return -1;
+        if (r == 0)
+            break;
+        JSON_STATS_ADD(dict_steps, 1);
+        r = PREEMPT_CALL(cursor_key_eq, cur->last.k, key, nkey, exact);
+        if (r)
+            goto found;
+    }
+    // ...then from the beginning up to the cursor.
+    json_cursor_rewind(cur);
+    while (cur->next < start) {
+        r = PREEMPT_CALL(cursor_step, cur, true);
+        if (r <= 0)
+            return r;
+        JSON_STATS_ADD(dict_steps, 1);
+        r = PREEMPT_CALL(cursor_key_eq, cur->last.k, key, nkey, exact);
+        if (r)
+            goto found;
+    }
+    return 0;
+
+found:
+    if (r < 0)
+        return -1;
+    *v = cur->last.v;
+    return 1;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_cursor_dict_get,
+        JsonCursor *cur,
+        const char *key,
+        JsonSpan *v)
+{
+    return PREEMPT_CALL(cursor_dict_get, cur, key, v, false);
+}
+
+PREEMPT_DECLF(
+    int,
+    json_cursor_dict_get_exact,
+        JsonCursor *cur,
+        const char *key,
+        JsonSpan *v)
+{
+    return PREEMPT_CALL(cursor_dict_get, cur, key, v, true);
+}
+
+// Returns the end of the scalar value at 'buf' (which must not be whitespace), or NULL if it is
+// not a scalar or on error.
+PREEMPT_DECLF(
+    static inline const char *,
+    skip_scalar,
+        const char *buf,
+        const char *buf_end)
+{
+    if (unlikely(buf[0] == '[' || buf[0] == '{'))
+        return NULL;
+    return PREEMPT_CALL(skip_obj, buf, buf_end);
+}
+
+// Decodes the dict past its '{' at 'buf' into 'out'; returns its end, or NULL on error.
+PREEMPT_DECLF(
+    static const char *,
+    record_decode_dict,
+        const JsonRecord *rec,
+        bool exact,
+        char *out,
+        const char *buf,
+        const char *buf_end);
+
+// Decodes the array past its '[' at 'buf' with the field 'f' of type JSON_RECORD_LIST; returns
+// its end, or NULL on error.
+PREEMPT_DECLF(
+    static const char *,
+    record_decode_list,
+        const JsonRecordField *f,
+        bool exact,
+        char *out,
+        const char *buf,
+        const char *buf_end)
+{
+    const JsonRecord *rec = f->rec;
+    char *elems = out + f->offset;
+    uint32_t n = 0;
+
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    if (unlikely(buf == buf_end))
+        return NULL;
+    if (buf[0] != ']') {
+        for (;;) {
+            if (n == f->size) {
+                if (!JSON_VALIDATING) {
+                    buf = PREEMPT_CALL(skip_rest, buf, buf_end);
+                    break;
+                }
+                buf = PREEMPT_CALL(skip_obj, buf, buf_end);
+            } else {
+                if (unlikely(buf[0] != '{'))
+                    return NULL;
+                PREEMPT_INCR(buf);
+                char *elem = elems + n * rec->size;
+                memset(elem, 0, rec->size);
+                buf = PREEMPT_CALL(record_decode_dict, rec, exact, elem, buf, buf_end);
+                ++n;
+            }
+            if (unlikely(!buf))
+                return NULL;
+            JSON_STATS_ADD(array_steps, 1);
+
+            buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+            if (unlikely(buf == buf_end))
+                return NULL;
+            if (buf[0] == ']') {
+                ++buf;
+                break;
+            }
+            if (unlikely(buf[0] != ','))
+                return NULL;
+            PREEMPT_INCR(buf);
+            buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+            if (unlikely(buf == buf_end))
+                return NULL;
+        }
+    } else {
+        ++buf;
+    }
+    if (unlikely(!buf))
+        return NULL;
+    memcpy(out + f->count_offset, &n, sizeof(n));
+    return buf;
+}
+
+// Decodes the value at 'buf' (which must not be whitespace) into the field 'f'; returns its end,
+// or NULL on error.
+PREEMPT_DECLF(
+    static const char *,
+    record_decode_value,
+        const JsonRecordField *f,
+        bool exact,
+        char *out,
+        const char *buf,
+        const char *buf_end)
+{
+    char c = buf[0];
+    if (f->type == JSON_RECORD_DICT || f->type == JSON_RECORD_LIST) {
+        const char *r;
+        if (c == (f->type == JSON_RECORD_DICT ? '{' : '[')) {
+            PREEMPT_INCR(buf);
+            r = f->type == JSON_RECORD_DICT
+                ? PREEMPT_CALL(record_decode_dict, f->rec, exact, out + f->offset, buf, buf_end)
+                : PREEMPT_CALL(record_decode_list, f, exact, out, buf, buf_end);
+        } else {
+            r = PREEMPT_CALL(skip_scalar, buf, buf_end);
+            if (unlikely(r && !json_is_null(buf, r)))
+                return NULL;
+        }
+        return r;
+    }
+
+    const char *r = PREEMPT_CALL(skip_scalar, buf, buf_end);
+    if (unlikely(!r))
+        return NULL;
+    if (c == 'n' && json_is_null(buf, r))
+        return r;
+    JSON_STATS_ADD(bytes_matched, r - buf);
+
+    char *dst = out + f->offset;
+    switch (f->type) {
+    case JSON_RECORD_INT: {
+        const char *v = buf;
+        const char *v_end = r;
+        if (c == '"') {
+            ++v;
+            --v_end;
+        }
+        int64_t x = json_parse_num(v, v_end, f->scale);
+        if (unlikely(x == INT64_MIN))
+            return NULL;
+        memcpy(dst, &x, sizeof(x));
+        return r;
+    }
+    case JSON_RECORD_BOOL: {
+        int x = json_parse_bool(buf, r);
+        if (unlikely(x < 0))
+            return NULL;
+        *(bool *) dst = x;
+        return r;
+    }
+    case JSON_RECORD_STR: {
+        size_t n = r - buf;
+        if (c == '"') {
+            if (unlikely(n - 2 >= f->size))
+                return NULL;
+            ssize_t m = PREEMPT_CALL(json_unesc, buf, r, dst);
+            if (unlikely(m < 0))
+                return NULL;
+            dst[m] = '\0';
+        } else {
+            if (unlikely(n >= f->size))
+                return NULL;
+            memcpy(dst, buf, n);
+            dst[n] = '\0';
+        }
+        return r;
+    }
+    case JSON_RECORD_CHAR:
+        *dst = c != '"' ? c : r - buf > 2 ? buf[1] : '\0';
+        return r;
+    default:
+        return NULL;
+    }
+}
+
+PREEMPT_DECLF(
+    static const char *,
+    record_decode_dict,
+        const JsonRecord *rec,
+        bool exact,
+        char *out,
+        const char *buf,
+        const char *buf_end)
+{
+    // Without a table, 'kd_match()' scans the entries linearly. The entries are only read.
+    static const JsonKeyDispatch no_kd = {0};
+    const JsonKeyDispatch *kd = rec->kd ? rec->kd : &no_kd;
+    JsonFieldEntry *keys = (JsonFieldEntry *) rec->keys;
+
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    if (unlikely(buf == buf_end))
+        return NULL;
+    if (buf[0] == '}')
+        return buf + 1;
+
+    for (;;) {
+        JsonSpan k = {buf, NULL};
+        buf = PREEMPT_CALL(skip_str, buf, buf_end);
+        if (unlikely(!buf))
+            return NULL;
+        k.end = buf;
+
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        if (unlikely(buf == buf_end))
+            return NULL;
+        if (unlikely(buf[0] != ':'))
+            return NULL;
+        PREEMPT_INCR(buf);
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        if (unlikely(buf == buf_end))
+            return NULL;
+
+        JsonFieldEntry *e;
+        if (exact) {
+            if (unlikely(PREEMPT_CALL(kd_match_exact, kd, keys, rec->nfields, k, &e) < 0))
+                return NULL;
+        } else {
+            e = PREEMPT_CALL(kd_match, kd, keys, rec->nfields, k.begin + 1, k.end - k.begin - 2);
+        }
+        JSON_STATS_ADD(dict_steps, 1);
+
+        buf = e
+            ? PREEMPT_CALL(record_decode_value, &rec->fields[e - keys], exact, out, buf, buf_end)
+            : PREEMPT_CALL(skip_obj, buf, buf_end);
+        if (unlikely(!buf))
+            return NULL;
+
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        if (unlikely(buf == buf_end))
+            return NULL;
+        if (buf[0] == '}')
+            return buf + 1;
+        if (unlikely(buf[0] != ','))
+            return NULL;
+        PREEMPT_INCR(buf);
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    }
+}
+
+PREEMPT_DECLF(
+    static inline int,
+    decode_record,
+        const char *buf,
+        const char *buf_end,
+        const JsonRecord *rec,
+        bool exact,
+        void *out)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    if (unlikely(buf == buf_end || buf[0] != '{'))
+        return -1;
+    PREEMPT_INCR(buf);
+    const char *r = PREEMPT_CALL(record_decode_dict, rec, exact, out, buf, buf_end);
+    if (unlikely(!r))
+        return -1;
+    return PREEMPT_CALL(check_trailing, r, buf_end);
+}
+
+PREEMPT_DECLF(
+    int,
+    json_decode_record,
+        const char *buf,
+        const char *buf_end,
+        const JsonRecord *rec,
+        void *out)
+{
+    return PREEMPT_CALL(decode_record, buf, buf_end, rec, false, out);
+}
+
+PREEMPT_DECLF(
+    int,
+    json_decode_record_exact,
+        const char *buf,
+        const char *buf_end,
+        const JsonRecord *rec,
+        void *out)
+{
+    return PREEMPT_CALL(decode_record, buf, buf_end, rec, true, out);
+}
+
+PREEMPT_DECLF(
+    bool,
+    json_streq,
+        const char *buf,
+        const char *buf_end,
+        const char *s)
+{
+    size_t nbuf = buf_end - buf;
+    if (nbuf < 2)
+        return false;
+    if (buf[0] != '"')
+        return false;
+
+    size_t n = nbuf - 2;
+    size_t i = 0;
+    while (i < n) {
+        char c = s[i];
+        if (c == '\0')
+            return false;
+        if (buf[i + 1] != c)
+            return false;
+        PREEMPT_INCR(i);
+    }
+    return buf_end[-1] == '"' && s[n] == '\0';
+}
+
+static inline int unesc_single(char c)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static const int8_t table[256] = {
+        [0 ... 255] = -1,
+        ['"'] = '"',
+        ['\\'] = '\\',
+        ['/'] = '/',
+        ['b'] = '\b',
+        ['f'] = '\f',
+        ['n'] = '\n',
+        ['r'] = '\r',
+        ['t'] = '\t',
+    };
+#pragma GCC diagnostic pop
+    return table[(unsigned char) c];
+}
+
+static int parse_hex_escape(const char *s)
 {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Woverride-init"
@@ -640,6 +1627,20 @@ bad:
             if (unlikely(res < 0)) { \
                 UNESC_RETURN_BAD(3); \
             } \
+            if (res >= 0xD800 && res < 0xDC00 && J_End_ - next_esc >= 10 && \
+                    next_esc[4] == '\\' && next_esc[5] == 'u') { \
+                /* A surrogate pair: a single 4-byte sequence. */ \
+                int lo = parse_hex_escape(next_esc + 6); \
+                if (lo >= 0xDC00 && lo < 0xE000) { \
+                    uint32_t cp = 0x10000 + ((res - 0xD800) << 10) + (lo - 0xDC00); \
+                    UNESC_PRODUCE_1(0xF0 | (cp >> 18)); \
+                    UNESC_PRODUCE_1(0x80 | ((cp >> 12) & 63)); \
+                    UNESC_PRODUCE_1(0x80 | ((cp >> 6) & 63)); \
+                    UNESC_PRODUCE_1(0x80 | (cp & 63)); \
+                    J_ = next_esc + 10; \
+                    continue; \
+                } \
+            } \
             if (res < 128) { \
                 UNESC_PRODUCE_1(res); \
             } else if (res < 2048) { \
@@ -668,10 +1669,15 @@ PREEMPT_DECLF(
         const char *src,
         size_t n)
 {
-    size_t i = 0;
-    while (i < n) {
-        dst[i] = src[i];
-        PREEMPT_INCR(i);
+    for (;;) {
+        size_t m = PREEMPT_BLOCK_LEN(n);
+        memcpy(dst, src, m);
+        PREEMPT_CHARGE(m);
+        if (m == n)
+            return;
+        dst += m;
+        src += m;
+        n -= m;
     }
 }
 
@@ -703,6 +1709,33 @@ PREEMPT_DECLF(
     return cur - out;
 }
 
+PREEMPT_DECLF(
+    int,
+    json_unesc_span,
+        const char *j,
+        const char *j_end,
+        char **arena,
+        JsonSpan *out)
+{
+    if (unlikely(j_end - j < 2 || j[0] != '"'))
+        return -1;
+
+    const char *inner = j + 1;
+    const char *inner_end = j_end - 1;
+    if (PREEMPT_CALL(find_next_escape, inner, inner_end) == inner_end) {
+        *out = (JsonSpan) {inner, inner_end};
+        return 0;
+    }
+
+    char *cur = *arena;
+    ssize_t n = PREEMPT_CALL(json_unesc, j, j_end, cur);
+    if (unlikely(n < 0))
+        return -1;
+    *out = (JsonSpan) {cur, cur + n};
+    *arena = cur + n;
+    return 1;
+}
+
 PREEMPT_DECLF(
     static inline bool,
     my_memeq_special,
@@ -710,15 +1743,18 @@ PREEMPT_DECLF(
         const char *q,
         size_t n)
 {
-    size_t i = 0;
-    while (i < n) {
-        char c = p[i];
-        if (c == '\0' || c != q[i]) {
+    for (;;) {
+        size_t m = PREEMPT_BLOCK_LEN(n);
+        // 'p' is NUL-terminated and may be shorter than 'm'.
+        if (strnlen(p, m) != m || memcmp(p, q, m) != 0)
             return false;
-        }
-        PREEMPT_INCR(i);
+        PREEMPT_CHARGE(m);
+        if (m == n)
+            return true;
+        p += m;
+        q += m;
+        n -= m;
     }
-    return true;
 }
 
 PREEMPT_DECLF(
@@ -795,3 +1831,410 @@ PREEMPT_DECLF(
 
     return buf == buf_end;
 }
+
+// Structural index ("tape").
+//
+// The tape lists all the values (and dict keys) in the order they appear in the buffer, so that
+// entries are sorted by 'begin'. The children of a container at index 'i' start at index 'i + 1'
+// and are linked by their 'next' fields; for dicts, a key is immediately followed by its value.
+
+#define TAPE_NONE UINT32_MAX
+
+PREEMPT_DECLF(
+    int,
+    json_tape_build,
+        JsonTape *t,
+        const char *buf,
+        const char *buf_end,
+        JsonTapeEntry *entries,
+        size_t nentries)
+{
+    if (unlikely((size_t) (buf_end - buf) >= UINT32_MAX))
+        return -1;
+
+    const char *base = buf;
+    size_t n = 0;
+    // The index of the innermost open container. While a container is open, its 'next' field
+    // holds the index of the enclosing one.
+    uint32_t open = TAPE_NONE;
+    // The index of the most recently completed child of the innermost open container.
+    uint32_t last = TAPE_NONE;
+
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+
+value:
+    if (unlikely(buf == buf_end || n == nentries))
+        return -1;
+    {
+        uint32_t i = n++;
+        entries[i].begin = buf - base;
+
+        char x = *buf;
+        if ((x & 0xDF) == 0x5B) {
+            // x is either '[' or '{'
+            entries[i].next = open;
+            open = i;
+            last = TAPE_NONE;
+            PREEMPT_INCR(buf);
+            buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+            if (unlikely(buf == buf_end))
+                return -1;
+            // ']' == '[' + 2 and '}' == '{' + 2.
+            if (*buf == x + 2)
+                goto close;
+            if (x == '{')
+                goto key;
+            goto value;
+        }
+
+        if (unlikely((MAIN_TABLE[(unsigned char) x] >> CLASS_OFFSET) == JSON_CLASS_BAD))
+            return -1;
+        buf = PREEMPT_CALL(skip_obj, buf, buf_end);
+        if (unlikely(!buf))
+            return -1;
+        entries[i].end = buf - base;
+        entries[i].next = n;
+        if (open != TAPE_NONE && base[entries[open].begin] == '{') {
+            entries[i - 1].next = n;
+        }
+        last = i;
+    }
+
+after_value:
+    if (open == TAPE_NONE) {
+        entries[0].next = 0;
+        *t = (JsonTape) {.base = base, .entries = entries, .nentries = n, .hint = 0};
+        return PREEMPT_CALL(check_trailing, buf, buf_end);
+    }
+    buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+    if (unlikely(buf == buf_end))
+        return -1;
+    {
+        bool in_dict = base[entries[open].begin] == '{';
+        char c = *buf;
+        if (c == ',') {
+            PREEMPT_INCR(buf);
+            buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+            if (in_dict)
+                goto key;
+            goto value;
+        }
+        if (unlikely(c != (in_dict ? '}' : ']')))
+            return -1;
+    }
+
+close:
+    {
+        bool in_dict = base[entries[open].begin] == '{';
+        if (last != TAPE_NONE) {
+            entries[last].next = 0;
+            if (in_dict) {
+                entries[last - 1].next = 0;
+            }
+        }
+        uint32_t i = open;
+        open = entries[i].next;
+        entries[i].end = buf + 1 - base;
+        entries[i].next = n;
+        if (open != TAPE_NONE && base[entries[open].begin] == '{') {
+            entries[i - 1].next = n;
+        }
+        last = i;
+        PREEMPT_INCR(buf);
+        goto after_value;
+    }
+
+key:
+    if (unlikely(n == nentries))
+        return -1;
+    {
+        uint32_t i = n++;
+        const char *key_end = PREEMPT_CALL(skip_str, buf, buf_end);
+        if (unlikely(!key_end))
+            return -1;
+        entries[i] = (JsonTapeEntry) {buf - base, key_end - base, TAPE_NONE};
+
+        buf = PREEMPT_CALL(skip_whitespace, key_end, buf_end);
+        if (unlikely(buf == buf_end || buf[0] != ':'))
+            return -1;
+        PREEMPT_INCR(buf);
+        buf = PREEMPT_CALL(skip_whitespace, buf, buf_end);
+        goto value;
+    }
+}
+
+// Returns the index of the entry that begins at 'p', or TAPE_NONE if there is none.
+static inline size_t tape_locate(JsonTape *t, const char *p)
+{
+    if (unlikely(!t->nentries || p < t->base || p >= t->base + t->entries[0].end))
+        return TAPE_NONE;
+
+    uint32_t off = p - t->base;
+    size_t lo = t->hint;
+    if (likely(lo < t->nentries && t->entries[lo].begin == off))
+        return lo;
+
+    lo = 0;
+    size_t hi = t->nentries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t x = t->entries[mid].begin;
+        if (x == off)
+            return mid;
+        if (x < off)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return TAPE_NONE;
+}
+
+// Returns the index of the first child of the container 'c' that must begin with 'open_bracket',
+// 0 if the container is empty, or TAPE_NONE on error.
+PREEMPT_DECLF(
+    static inline size_t,
+    tape_first_child,
+        JsonTape *t,
+        JsonSpan c,
+        char open_bracket)
+{
+    c.begin = PREEMPT_CALL(skip_whitespace, c.begin, c.end);
+    size_t i = tape_locate(t, c.begin);
+    if (unlikely(i == TAPE_NONE || c.begin[0] != open_bracket))
+        return TAPE_NONE;
+    size_t j = i + 1;
+    if (j == t->nentries || t->entries[j].begin >= t->entries[i].end)
+        return 0;
+    return j;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_array_next,
+        JsonTape *t,
+        JsonSpan a,
+        JsonSpan *e)
+{
+    size_t j;
+    if (e->end == NULL) {
+        j = PREEMPT_CALL(tape_first_child, t, a, '[');
+    } else {
+        j = tape_locate(t, e->begin);
+        if (likely(j != TAPE_NONE))
+            j = t->entries[j].next;
+    }
+    if (unlikely(j == TAPE_NONE))
+        return -1;
+    if (j == 0)
+        return 0;
+
+    t->hint = j;
+    *e = json_tape_span(t, j);
+    JSON_STATS_ADD(array_steps, 1);
+    return 1;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_dict_next,
+        JsonTape *t,
+        JsonSpan d,
+        JsonSpan *k,
+        JsonSpan *v)
+{
+    size_t j;
+    if (v->end == NULL) {
+        j = PREEMPT_CALL(tape_first_child, t, d, '{');
+    } else {
+        j = tape_locate(t, v->begin);
+        if (likely(j != TAPE_NONE))
+            j = t->entries[j].next;
+    }
+    if (unlikely(j == TAPE_NONE))
+        return -1;
+    if (j == 0)
+        return 0;
+
+    t->hint = j + 1;
+    *k = json_tape_span(t, j);
+    *v = json_tape_span(t, j + 1);
+    JSON_STATS_ADD(dict_steps, 1);
+    return 1;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_parse_dict_fields,
+        JsonTape *t,
+        const char *buf,
+        const char *buf_end,
+        JsonFieldEntry *entries,
+        int nentries)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    JsonSpan d = {buf, buf_end};
+    JsonSpan k = {0};
+    JsonSpan v = {0};
+    JsonFieldEntry *entries_end = entries + nentries;
+    int r;
+
+    while ((r = PREEMPT_CALL(json_tape_dict_next, t, d, &k, &v)) > 0) {
+        for (JsonFieldEntry *e = entries; e != entries_end; ++e) {
+            size_t nk = k.end - k.begin - 2;
+            if (nk == e->nkey && PREEMPT_CALL(span_eq, e->key, k.begin + 1, nk)) {
+                e->v_begin = v.begin;
+                e->v_end = v.end;
+                JSON_STATS_ADD(bytes_matched, v.end - v.begin);
+                break;
+            }
+        }
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_parse_dict_fields_exact,
+        JsonTape *t,
+        const char *buf,
+        const char *buf_end,
+        JsonFieldEntry *entries,
+        int nentries)
+{
+    // Without a table, 'kd_match()' scans the entries linearly.
+    static const JsonKeyDispatch kd = {0};
+
+    JSON_STATS_CALL(buf, buf_end);
+    JsonSpan d = {buf, buf_end};
+    JsonSpan k = {0};
+    JsonSpan v = {0};
+    int r;
+
+    while ((r = PREEMPT_CALL(json_tape_dict_next, t, d, &k, &v)) > 0) {
+        JsonFieldEntry *e;
+        if (unlikely(PREEMPT_CALL(kd_match_exact, &kd, entries, nentries, k, &e) < 0)) {
+            return -1;
+        }
+        if (e) {
+            e->v_begin = v.begin;
+            e->v_end = v.end;
+            JSON_STATS_ADD(bytes_matched, v.end - v.begin);
+        }
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_parse_dict_fields_kd,
+        JsonTape *t,
+        const char *buf,
+        const char *buf_end,
+        JsonFieldEntry *entries,
+        int nentries,
+        const JsonKeyDispatch *kd)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    JsonSpan d = {buf, buf_end};
+    JsonSpan k = {0};
+    JsonSpan v = {0};
+    int nleft = nentries;
+    int r;
+
+    while ((r = PREEMPT_CALL(json_tape_dict_next, t, d, &k, &v)) > 0) {
+        JsonFieldEntry *e = PREEMPT_CALL(kd_match, kd, entries, nentries, k.begin + 1, k.end - k.begin - 2);
+        if (e && kd_store(kd, e, v, &nleft) && !JSON_VALIDATING) {
+            return 0;
+        }
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_parse_dict_fields_kd_exact,
+        JsonTape *t,
+        const char *buf,
+        const char *buf_end,
+        JsonFieldEntry *entries,
+        int nentries,
+        const JsonKeyDispatch *kd)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    JsonSpan d = {buf, buf_end};
+    JsonSpan k = {0};
+    JsonSpan v = {0};
+    int nleft = nentries;
+    int r;
+
+    while ((r = PREEMPT_CALL(json_tape_dict_next, t, d, &k, &v)) > 0) {
+        JsonFieldEntry *e;
+        if (unlikely(PREEMPT_CALL(kd_match_exact, kd, entries, nentries, k, &e) < 0)) {
+            return -1;
+        }
+        if (e && kd_store(kd, e, v, &nleft) && !JSON_VALIDATING) {
+            return 0;
+        }
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_parse_array_elems,
+        JsonTape *t,
+        const char *buf,
+        const char *buf_end,
+        JsonElemEntry *entries,
+        int nentries)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    if (unlikely(!nentries))
+        return 0;
+
+    JsonSpan a = {buf, buf_end};
+    JsonSpan v = {0};
+    JsonElemEntry *entries_end = entries + nentries;
+    int r;
+    while ((r = PREEMPT_CALL(json_tape_array_next, t, a, &v)) > 0) {
+        *entries++ = (JsonElemEntry) {v.begin, v.end};
+        JSON_STATS_ADD(bytes_matched, v.end - v.begin);
+        if (entries == entries_end) {
+            return 0;
+        }
+    }
+    return r;
+}
+
+PREEMPT_DECLF(
+    int,
+    json_tape_parse_array_elems_sparse,
+        JsonTape *t,
+        const char *buf,
+        const char *buf_end,
+        JsonSparseElemEntry *entries,
+        int nentries)
+{
+    JSON_STATS_CALL(buf, buf_end);
+    if (unlikely(!nentries))
+        return 0;
+
+    JsonSpan a = {buf, buf_end};
+    JsonSpan v = {0};
+    JsonSparseElemEntry *entries_end = entries + nentries;
+    int r;
+    size_t i = 0;
+    while ((r = PREEMPT_CALL(json_tape_array_next, t, a, &v)) > 0) {
+        while (entries->i == i) {
+            entries->v_begin = v.begin;
+            entries->v_end = v.end;
+            JSON_STATS_ADD(bytes_matched, v.end - v.begin);
+            ++entries;
+            if (entries == entries_end) {
+                return 0;
+            }
+        }
+        ++i;
+    }
+    return r;
+}
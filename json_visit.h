@@ -43,6 +43,15 @@ int json_parse_dict_fields(const char *buf, const char *buf_end, JsonFieldEntry
 // Returns 0 on success, -1 on error.
 int json_parse_dict_fields_exact(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries);
 
+// Same as 'json_parse_dict_fields()', but keys are looked up through the key dispatch 'kd'
+// (normally generated by the DSL), which may also request an early exit (see JSON_KD_EARLY_EXIT).
+// Without an early exit, the last occurrence of a key wins; with it, the first one does.
+// For an early exit to work, all the entries must initially have 'v_begin == NULL'.
+int json_parse_dict_fields_kd(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
+// Same as 'json_parse_dict_fields_kd()', but with exact matching of keys.
+int json_parse_dict_fields_kd_exact(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
 // Fills 'entries' with 'nentries' (or less, if the total number of elements is less than that)
 // first elements of the JSON array at {buf ... buf_end}.
 // Returns 0 on success, -1 on error.
@@ -56,14 +65,44 @@ int json_parse_array_elems(const char *buf, const char *buf_end, JsonElemEntry *
 // Returns 0 on success, -1 on error.
 int json_parse_array_elems_sparse(const char *buf, const char *buf_end, JsonSparseElemEntry *entries, int nentries);
 
+// Fills the entries of all the nodes of the extraction plan 'plan' (see 'JsonPlan') from the JSON
+// value at {buf ... buf_end} in a single pass: the values that have a node of their own are parsed
+// as they are met, everything else is skipped over. The entries of a node are filled as by the
+// corresponding 'json_parse_*' function; if a key or an index occurs more than once, the node of its
+// value keeps the results of the last occurrence only (the first one, with JSON_KD_EARLY_EXIT).
+// All the entries must initially be empty ('v_begin == NULL').
+// Returns 0 on success, -1 on error. A value that has a node but is either missing or not a
+// container of the expected kind is an error too; it does not stop the parsing of the rest, so
+// that everything else is still filled.
+int json_parse_plan(const char *buf, const char *buf_end, const JsonPlan *plan);
+
+// Decodes the JSON dict at {buf ... buf_end} into the C struct at 'out' according to the record
+// 'rec' (see 'JsonRecord') in a single pass: each wanted value is converted as soon as it is met.
+// Fields whose keys are absent, or whose values are 'null', are left as they are; if a key occurs
+// more than once, the last occurrence wins.
+// Returns 0 on success, -1 on error, including a value that cannot be converted to its field's
+// type, and a string that does not fit into its field in escaped form.
+int json_decode_record(const char *buf, const char *buf_end, const JsonRecord *rec, void *out);
+
+// Same as 'json_decode_record()', but with exact matching of keys.
+int json_decode_record_exact(const char *buf, const char *buf_end, const JsonRecord *rec, void *out);
+
 // Checks if {buf ... buf_end} is a JSON string equal to the C string 's'.
 // This is "sloppy" comparison, which does not account for JSON escapes.
 bool json_streq(const char *buf, const char *buf_end, const char *s);
 
 // Unescapes the JSON string {j ... j_end} into 'out'.
-// Returns the number of bytes written.
+// Returns the number of bytes written, which is at most (j_end - j - 2). A surrogate pair of
+// '\u' escapes is written as a single 4-byte UTF-8 sequence.
 ssize_t json_unesc(const char *j, const char *j_end, char *out);
 
+// Unescapes the JSON string {j ... j_end} into '*out' without copying if possible.
+// If the string contains no escapes, '*out' is set to its contents within {j ... j_end} and 0 is
+// returned. Otherwise, the string is unescaped into '*arena', which must have at least
+// (j_end - j) bytes left, '*arena' is advanced past the result and 1 is returned.
+// Returns -1 on error.
+int json_unesc_span(const char *j, const char *j_end, char **arena, JsonSpan *out);
+
 // Checks if {buf ... buf_end} is a JSON string equal to the C string 's'.
 // This is "exact" comparison.
 int json_streq_exact(const char *j, const char *j_end, const char *s);
@@ -72,6 +111,54 @@ int json_streq_exact(const char *j, const char *j_end, const char *s);
 // This is "exact" comparison.
 int json_streq_exact_b(const char *j, const char *j_end, const char *buf, const char *buf_end);
 
+// Builds the structural index ("tape") of the JSON object at {buf ... buf_end} in a single pass,
+// storing it into 'entries' (which is an array of size 'nentries') and describing it in '*t'.
+// There is one entry per value and per dict key; a tape of ((buf_end - buf) / 2 + 1) entries is
+// always sufficient. The buffer must be less than 4 GiB long.
+// Returns 0 on success, -1 on error (including the case of 'entries' being too small).
+//
+// The 'json_tape_*' functions below then behave as their non-tape counterparts on spans lying
+// within the indexed buffer, but move from one element to the next in O(1) without touching the
+// text (except for matching dict keys).
+int json_tape_build(JsonTape *t, const char *buf, const char *buf_end, JsonTapeEntry *entries, size_t nentries);
+
+int json_tape_array_next(JsonTape *t, JsonSpan a, JsonSpan *e);
+
+int json_tape_dict_next(JsonTape *t, JsonSpan d, JsonSpan *k, JsonSpan *v);
+
+int json_tape_parse_dict_fields(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries);
+
+int json_tape_parse_dict_fields_exact(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries);
+
+int json_tape_parse_dict_fields_kd(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
+int json_tape_parse_dict_fields_kd_exact(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
+int json_tape_parse_array_elems(JsonTape *t, const char *buf, const char *buf_end, JsonElemEntry *entries, int nentries);
+
+int json_tape_parse_array_elems_sparse(JsonTape *t, const char *buf, const char *buf_end, JsonSparseElemEntry *entries, int nentries);
+
+// Same as 'json_array_next()'/'json_dict_next()' on the container of 'cur', continuing after the
+// element the cursor was last moved to (see 'JsonCursor').
+int json_cursor_array_next(JsonCursor *cur, JsonSpan *e);
+
+int json_cursor_dict_next(JsonCursor *cur, JsonSpan *k, JsonSpan *v);
+
+// Writes the span of element 'i' of the array of 'cur' into '*e' and returns 1; returns 0 if there
+// is no such element, -1 on error. Scanning resumes from the element visited last or from the
+// nearest mark before 'i', so that looking up elements in increasing order costs a single pass,
+// and looking up an element again is O(1) if it was the last one or O('every') otherwise.
+int json_cursor_array_at(JsonCursor *cur, size_t i, JsonSpan *e);
+
+// Writes the span of the value of the key 'key' of the dict of 'cur' into '*v' ("sloppy" match)
+// and returns 1; returns 0 if there is no such key, -1 on error. Scanning resumes after the
+// element visited last and wraps around, so that looking up keys in the order they occur costs a
+// single pass. If a key occurs more than once, the first occurrence after the cursor is found.
+int json_cursor_dict_get(JsonCursor *cur, const char *key, JsonSpan *v);
+
+// Same as 'json_cursor_dict_get()', but with exact matching of keys.
+int json_cursor_dict_get_exact(JsonCursor *cur, const char *key, JsonSpan *v);
+
 in_header bool json_span_streq(JsonSpan x, const char *s)
 {
     return json_streq(x.begin, x.end, s);
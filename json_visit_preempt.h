@@ -16,18 +16,58 @@ int PREEMPT_json_parse_dict_fields(const char *buf, const char *buf_end, JsonFie
 
 int PREEMPT_json_parse_dict_fields_exact(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, PreemptDevice *p);
 
+int PREEMPT_json_parse_dict_fields_kd(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd, PreemptDevice *p);
+
+int PREEMPT_json_parse_dict_fields_kd_exact(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd, PreemptDevice *p);
+
 int PREEMPT_json_parse_array_elems(const char *buf, const char *buf_end, JsonElemEntry *entries, int nentries, PreemptDevice *p);
 
 int PREEMPT_json_parse_array_elems_sparse(const char *buf, const char *buf_end, JsonSparseElemEntry *entries, int nentries, PreemptDevice *p);
 
+int PREEMPT_json_parse_plan(const char *buf, const char *buf_end, const JsonPlan *plan, PreemptDevice *p);
+
+int PREEMPT_json_decode_record(const char *buf, const char *buf_end, const JsonRecord *rec, void *out, PreemptDevice *p);
+
+int PREEMPT_json_decode_record_exact(const char *buf, const char *buf_end, const JsonRecord *rec, void *out, PreemptDevice *p);
+
 bool PREEMPT_json_streq(const char *buf, const char *buf_end, const char *s, PreemptDevice *p);
 
 ssize_t PREEMPT_json_unesc(const char *j, const char *j_end, char *out, PreemptDevice *p);
 
+int PREEMPT_json_unesc_span(const char *j, const char *j_end, char **arena, JsonSpan *out, PreemptDevice *p);
+
 int PREEMPT_json_streq_exact(const char *j, const char *j_end, const char *s, PreemptDevice *p);
 
 int PREEMPT_json_streq_exact_b(const char *j, const char *j_end, const char *buf, const char *buf_end, PreemptDevice *p);
 
+int PREEMPT_json_tape_build(JsonTape *t, const char *buf, const char *buf_end, JsonTapeEntry *entries, size_t nentries, PreemptDevice *p);
+
+int PREEMPT_json_tape_array_next(JsonTape *t, JsonSpan a, JsonSpan *e, PreemptDevice *p);
+
+int PREEMPT_json_tape_dict_next(JsonTape *t, JsonSpan d, JsonSpan *k, JsonSpan *v, PreemptDevice *p);
+
+int PREEMPT_json_tape_parse_dict_fields(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, PreemptDevice *p);
+
+int PREEMPT_json_tape_parse_dict_fields_exact(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, PreemptDevice *p);
+
+int PREEMPT_json_tape_parse_dict_fields_kd(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd, PreemptDevice *p);
+
+int PREEMPT_json_tape_parse_dict_fields_kd_exact(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd, PreemptDevice *p);
+
+int PREEMPT_json_tape_parse_array_elems(JsonTape *t, const char *buf, const char *buf_end, JsonElemEntry *entries, int nentries, PreemptDevice *p);
+
+int PREEMPT_json_tape_parse_array_elems_sparse(JsonTape *t, const char *buf, const char *buf_end, JsonSparseElemEntry *entries, int nentries, PreemptDevice *p);
+
+int PREEMPT_json_cursor_array_next(JsonCursor *cur, JsonSpan *e, PreemptDevice *p);
+
+int PREEMPT_json_cursor_dict_next(JsonCursor *cur, JsonSpan *k, JsonSpan *v, PreemptDevice *p);
+
+int PREEMPT_json_cursor_array_at(JsonCursor *cur, size_t i, JsonSpan *e, PreemptDevice *p);
+
+int PREEMPT_json_cursor_dict_get(JsonCursor *cur, const char *key, JsonSpan *v, PreemptDevice *p);
+
+int PREEMPT_json_cursor_dict_get_exact(JsonCursor *cur, const char *key, JsonSpan *v, PreemptDevice *p);
+
 in_header bool PREEMPT_json_span_streq(JsonSpan x, const char *s, PreemptDevice *p)
 {
     return PREEMPT_json_streq(x.begin, x.end, s, p);
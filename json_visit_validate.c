@@ -0,0 +1,5 @@
+#include "json_visit_validate.h"
+
+#define JSON_PREEMPTIBLE 0
+#define JSON_VALIDATING 1
+#include "json_visit.c.tpl"
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+#include "json_validate.h"
+
+// The validating build of the 'json_visit.h' functions: same semantics, except that everything
+// the parser passes over is checked with 'json_validate_*()' and invalid JSON is an error; see
+// 'JSON_VALIDATING' in 'json_visit.c.tpl'.
+
+const char *VALIDATE_json_skip_ws(const char *buf, const char *buf_end);
+
+uint8_t VALIDATE_json_classify(const char *buf, const char *buf_end);
+
+int VALIDATE_json_array_next(JsonSpan a, JsonSpan *e);
+
+int VALIDATE_json_dict_next(JsonSpan a, JsonSpan *k, JsonSpan *v);
+
+int VALIDATE_json_parse_dict_fields(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries);
+
+int VALIDATE_json_parse_dict_fields_exact(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries);
+
+int VALIDATE_json_parse_dict_fields_kd(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
+int VALIDATE_json_parse_dict_fields_kd_exact(const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
+int VALIDATE_json_parse_array_elems(const char *buf, const char *buf_end, JsonElemEntry *entries, int nentries);
+
+int VALIDATE_json_parse_array_elems_sparse(const char *buf, const char *buf_end, JsonSparseElemEntry *entries, int nentries);
+
+int VALIDATE_json_parse_plan(const char *buf, const char *buf_end, const JsonPlan *plan);
+
+int VALIDATE_json_decode_record(const char *buf, const char *buf_end, const JsonRecord *rec, void *out);
+
+int VALIDATE_json_decode_record_exact(const char *buf, const char *buf_end, const JsonRecord *rec, void *out);
+
+bool VALIDATE_json_streq(const char *buf, const char *buf_end, const char *s);
+
+ssize_t VALIDATE_json_unesc(const char *j, const char *j_end, char *out);
+
+int VALIDATE_json_unesc_span(const char *j, const char *j_end, char **arena, JsonSpan *out);
+
+int VALIDATE_json_streq_exact(const char *j, const char *j_end, const char *s);
+
+int VALIDATE_json_streq_exact_b(const char *j, const char *j_end, const char *buf, const char *buf_end);
+
+int VALIDATE_json_tape_build(JsonTape *t, const char *buf, const char *buf_end, JsonTapeEntry *entries, size_t nentries);
+
+int VALIDATE_json_tape_array_next(JsonTape *t, JsonSpan a, JsonSpan *e);
+
+int VALIDATE_json_tape_dict_next(JsonTape *t, JsonSpan d, JsonSpan *k, JsonSpan *v);
+
+int VALIDATE_json_tape_parse_dict_fields(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries);
+
+int VALIDATE_json_tape_parse_dict_fields_exact(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries);
+
+int VALIDATE_json_tape_parse_dict_fields_kd(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
+int VALIDATE_json_tape_parse_dict_fields_kd_exact(JsonTape *t, const char *buf, const char *buf_end, JsonFieldEntry *entries, int nentries, const JsonKeyDispatch *kd);
+
+int VALIDATE_json_tape_parse_array_elems(JsonTape *t, const char *buf, const char *buf_end, JsonElemEntry *entries, int nentries);
+
+int VALIDATE_json_tape_parse_array_elems_sparse(JsonTape *t, const char *buf, const char *buf_end, JsonSparseElemEntry *entries, int nentries);
+
+int VALIDATE_json_cursor_array_next(JsonCursor *cur, JsonSpan *e);
+
+int VALIDATE_json_cursor_dict_next(JsonCursor *cur, JsonSpan *k, JsonSpan *v);
+
+int VALIDATE_json_cursor_array_at(JsonCursor *cur, size_t i, JsonSpan *e);
+
+int VALIDATE_json_cursor_dict_get(JsonCursor *cur, const char *key, JsonSpan *v);
+
+int VALIDATE_json_cursor_dict_get_exact(JsonCursor *cur, const char *key, JsonSpan *v);
+
+in_header bool VALIDATE_json_span_streq(JsonSpan x, const char *s)
+{
+    return VALIDATE_json_streq(x.begin, x.end, s);
+}
+
+in_header char VALIDATE_json_span_classify(JsonSpan x)
+{
+    return VALIDATE_json_classify(x.begin, x.end);
+}
+
+in_header int VALIDATE_json_span_streq_exact(JsonSpan x, const char *s)
+{
+    return VALIDATE_json_streq_exact(x.begin, x.end, s);
+}
+
+in_header int VALIDATE_json_span_streq_exact_b(JsonSpan x, const char *buf, const char *buf_end)
+{
+    return VALIDATE_json_streq_exact_b(x.begin, x.end, buf, buf_end);
+}
@@ -0,0 +1,286 @@
+#include "json_write.h"
+#include "json_esc.h"
+#include "json_gen_num.h"
+
+enum { DEFAULT_CAP = 256 };
+
+void json_writer_init(JsonWriter *w, char *buf, size_t cap, unsigned flags)
+{
+    *w = (JsonWriter) {.flags = flags};
+    if (buf) {
+        w->buf = buf;
+        w->cap = cap;
+    } else {
+        w->cap = cap ? cap : DEFAULT_CAP;
+        w->buf = malloc_or_die(w->cap, sizeof(char));
+        w->owned = true;
+    }
+}
+
+void json_writer_destroy(JsonWriter *w)
+{
+    if (w->owned) {
+        free(w->buf);
+    }
+    free(w->segs);
+    free(w->iov);
+}
+
+void json_writer_reset(JsonWriter *w)
+{
+    w->len = 0;
+    w->overflow = false;
+    w->need_comma = false;
+    w->nsegs = 0;
+    w->seg_begin = 0;
+}
+
+// Returns the pointer to write (at most) 'n' bytes to, or NULL if there is no space.
+static inline char *reserve(JsonWriter *w, size_t n)
+{
+    if (unlikely(w->overflow))
+        return NULL;
+    if (likely(w->cap - w->len >= n))
+        return w->buf + w->len;
+
+    if (!w->owned) {
+        w->overflow = true;
+        return NULL;
+    }
+    size_t cap = w->cap * 2;
+    if (cap - w->len < n)
+        cap = w->len + n;
+    w->buf = realloc_or_die(w->buf, cap, sizeof(char));
+    w->cap = cap;
+    return w->buf + w->len;
+}
+
+static inline void put(JsonWriter *w, const char *s, size_t ns)
+{
+    char *p = reserve(w, ns);
+    if (likely(p != NULL)) {
+        memcpy(p, s, ns);
+        w->len += ns;
+    }
+}
+
+static inline void put_char(JsonWriter *w, char c)
+{
+    char *p = reserve(w, 1);
+    if (likely(p != NULL)) {
+        *p = c;
+        ++w->len;
+    }
+}
+
+static void put_esc(JsonWriter *w, const char *s, size_t ns)
+{
+    if (unlikely(w->overflow))
+        return;
+    size_t room = w->cap - w->len;
+    size_t n = json_esc_bounded(s, ns, w->buf + w->len, room);
+    if (n > room) {
+        char *p = reserve(w, n);
+        if (!p)
+            return;
+        json_esc_bounded(s, ns, p, n);
+    }
+    w->len += n;
+}
+
+static inline void put_sep(JsonWriter *w)
+{
+    if (w->need_comma) {
+        put_char(w, ',');
+    }
+}
+
+static void push_seg(JsonWriter *w, const char *ref, size_t off, size_t len)
+{
+    if (w->nsegs == w->capsegs) {
+        w->segs = x2realloc_or_die(w->segs, &w->capsegs, sizeof(JsonWriterSeg));
+    }
+    w->segs[w->nsegs++] = (JsonWriterSeg) {.ref = ref, .off = off, .len = len};
+}
+
+static void flush_run(JsonWriter *w)
+{
+    if (w->len > w->seg_begin) {
+        push_seg(w, NULL, w->seg_begin, w->len - w->seg_begin);
+        w->seg_begin = w->len;
+    }
+}
+
+JsonSpan json_writer_span(const JsonWriter *w)
+{
+    assert(!(w->flags & JSON_WRITER_IOV));
+    if (w->overflow)
+        return (JsonSpan) {NULL, NULL};
+    return (JsonSpan) {w->buf, w->buf + w->len};
+}
+
+const struct iovec *json_writer_iov(JsonWriter *w, size_t *niov, size_t *ntotal)
+{
+    assert(w->flags & JSON_WRITER_IOV);
+    if (w->overflow)
+        return NULL;
+
+    flush_run(w);
+    if (w->capiov < w->nsegs) {
+        w->iov = realloc_or_die(w->iov, w->nsegs, sizeof(struct iovec));
+        w->capiov = w->nsegs;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < w->nsegs; ++i) {
+        JsonWriterSeg s = w->segs[i];
+        const char *base = s.ref ? s.ref : w->buf + s.off;
+        w->iov[i] = (struct iovec) {.iov_base = (void *) base, .iov_len = s.len};
+        total += s.len;
+    }
+    *niov = w->nsegs;
+    if (ntotal) {
+        *ntotal = total;
+    }
+    return w->iov;
+}
+
+JsonWriterKey json_wkey_new(const char *key, size_t nkey)
+{
+    // Each byte takes at most 6 bytes escaped; plus the quotes and the colon.
+    size_t cap = 6 * nkey + 3;
+    char *data = malloc_or_die(cap, sizeof(char));
+    data[0] = '"';
+    size_t n = 1 + json_esc_bounded(key, nkey, data + 1, cap - 3);
+    data[n++] = '"';
+    data[n++] = ':';
+    return (JsonWriterKey) {data, n};
+}
+
+void json_wkey_free(JsonWriterKey k)
+{
+    free((char *) k.data);
+}
+
+void json_write_obj_begin(JsonWriter *w)
+{
+    put_sep(w);
+    put_char(w, '{');
+    w->need_comma = false;
+}
+
+void json_write_obj_end(JsonWriter *w)
+{
+    put_char(w, '}');
+    w->need_comma = true;
+}
+
+void json_write_arr_begin(JsonWriter *w)
+{
+    put_sep(w);
+    put_char(w, '[');
+    w->need_comma = false;
+}
+
+void json_write_arr_end(JsonWriter *w)
+{
+    put_char(w, ']');
+    w->need_comma = true;
+}
+
+void json_write_key(JsonWriter *w, const char *key, size_t nkey)
+{
+    put_sep(w);
+    put_char(w, '"');
+    put_esc(w, key, nkey);
+    put(w, "\":", 2);
+    w->need_comma = false;
+}
+
+void json_write_wkey(JsonWriter *w, const JsonWriterKey *k)
+{
+    put_sep(w);
+    put(w, k->data, k->ndata);
+    w->need_comma = false;
+}
+
+void json_write_str(JsonWriter *w, const char *s, size_t ns)
+{
+    put_sep(w);
+    put_char(w, '"');
+    put_esc(w, s, ns);
+    put_char(w, '"');
+    w->need_comma = true;
+}
+
+// The worst-case length of a number; if there is less room than that, the number is formatted
+// into a temporary buffer first, so that only its actual length counts against the capacity.
+static inline size_t num_maxlen(uint8_t scale)
+{
+    return (scale > 20 ? scale : 20) + 3;
+}
+
+void json_write_unum(JsonWriter *w, uint64_t x, uint8_t scale)
+{
+    put_sep(w);
+    size_t maxlen = num_maxlen(scale);
+    if (likely(!w->overflow && w->cap - w->len >= maxlen)) {
+        w->len += json_gen_unum(w->buf + w->len, x, scale);
+    } else {
+        char tmp[maxlen];
+        put(w, tmp, json_gen_unum(tmp, x, scale));
+    }
+    w->need_comma = true;
+}
+
+void json_write_inum(JsonWriter *w, int64_t x, uint8_t scale)
+{
+    put_sep(w);
+    size_t maxlen = num_maxlen(scale);
+    if (likely(!w->overflow && w->cap - w->len >= maxlen)) {
+        w->len += json_gen_inum(w->buf + w->len, x, scale);
+    } else {
+        char tmp[maxlen];
+        put(w, tmp, json_gen_inum(tmp, x, scale));
+    }
+    w->need_comma = true;
+}
+
+void json_write_bool(JsonWriter *w, bool x)
+{
+    put_sep(w);
+    if (x) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+    w->need_comma = true;
+}
+
+void json_write_null(JsonWriter *w)
+{
+    put_sep(w);
+    put(w, "null", 4);
+    w->need_comma = true;
+}
+
+void json_write_raw(JsonWriter *w, JsonSpan v)
+{
+    put_sep(w);
+    put(w, v.begin, v.end - v.begin);
+    w->need_comma = true;
+}
+
+void json_write_raw_ref(JsonWriter *w, JsonSpan v)
+{
+    size_t n = v.end - v.begin;
+    if (!(w->flags & JSON_WRITER_IOV) || n < JSON_WRITER_MIN_REF) {
+        json_write_raw(w, v);
+        return;
+    }
+    put_sep(w);
+    if (w->overflow)
+        return;
+    flush_run(w);
+    push_seg(w, v.begin, 0, n);
+    w->need_comma = true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "common.h"
+#include "json_common.h"
+#include <sys/uio.h>
+
+// A streaming JSON writer.
+//
+// Values are appended in document order with the 'json_write_*()' functions; commas and colons
+// are inserted automatically. The output goes either into a caller-provided buffer of fixed size
+// (running out of space sets a sticky error, see 'json_writer_ok()') or into a buffer owned by
+// the writer that grows as needed.
+//
+// With 'JSON_WRITER_IOV', spans passed to 'json_write_raw_ref()' are not copied but referenced
+// from the output, which is then retrieved as an 'iovec' list with 'json_writer_iov()'.
+
+enum {
+    JSON_WRITER_IOV = 1 << 0,
+};
+
+// Spans shorter than this are copied by 'json_write_raw_ref()' anyway: a separate 'iovec' entry
+// costs more than the copy.
+#define JSON_WRITER_MIN_REF 64
+
+// A key escaped in advance, together with the quotes and the colon.
+typedef struct {
+    const char *data;
+    size_t ndata;
+} JsonWriterKey;
+
+// A key from a string literal that has nothing to escape, e.g. 'JSON_WKEY_LIT("price")'.
+#define JSON_WKEY_LIT(K) {"\"" K "\":", sizeof(K) + 2}
+
+typedef struct {
+    const char *ref;
+    size_t off;
+    size_t len;
+} JsonWriterSeg;
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    unsigned flags;
+    bool owned;
+    bool overflow;
+    // Whether a comma is needed before the next key or value.
+    bool need_comma;
+
+    // For 'JSON_WRITER_IOV': the output so far, except for {buf+seg_begin ... buf+len}.
+    // Segments with 'ref' == NULL are {buf+off ... buf+off+len}.
+    JsonWriterSeg *segs;
+    size_t nsegs;
+    size_t capsegs;
+    size_t seg_begin;
+    struct iovec *iov;
+    size_t capiov;
+} JsonWriter;
+
+// If 'buf' is NULL, the writer allocates a buffer of 'cap' bytes (or some default if 0) and grows
+// it as needed.
+void json_writer_init(JsonWriter *w, char *buf, size_t cap, unsigned flags);
+
+void json_writer_destroy(JsonWriter *w);
+
+// Discards the output, keeping the buffers for reuse.
+void json_writer_reset(JsonWriter *w);
+
+// Returns false if the caller-provided buffer was too small for the output.
+in_header bool json_writer_ok(const JsonWriter *w)
+{
+    return !w->overflow;
+}
+
+// Returns the output; must not be used with 'JSON_WRITER_IOV'. Returns {NULL, NULL} if
+// 'json_writer_ok()' is false.
+JsonSpan json_writer_span(const JsonWriter *w);
+
+// Returns the output as a list of '*niov' entries, valid until the next call on 'w', and
+// stores the total length into '*ntotal' if it is not NULL. Requires 'JSON_WRITER_IOV'.
+// Returns NULL if 'json_writer_ok()' is false.
+const struct iovec *json_writer_iov(JsonWriter *w, size_t *niov, size_t *ntotal);
+
+// Escapes 'key' in advance; free the result with 'json_wkey_free()'.
+JsonWriterKey json_wkey_new(const char *key, size_t nkey);
+
+void json_wkey_free(JsonWriterKey k);
+
+void json_write_obj_begin(JsonWriter *w);
+
+void json_write_obj_end(JsonWriter *w);
+
+void json_write_arr_begin(JsonWriter *w);
+
+void json_write_arr_end(JsonWriter *w);
+
+// Writes a dict key, escaping it.
+void json_write_key(JsonWriter *w, const char *key, size_t nkey);
+
+// Writes a dict key escaped in advance.
+void json_write_wkey(JsonWriter *w, const JsonWriterKey *k);
+
+// Writes a string, escaping it as per 'json_esc_bounded()'.
+void json_write_str(JsonWriter *w, const char *s, size_t ns);
+
+// Writes a number as per 'json_gen_unum()'.
+void json_write_unum(JsonWriter *w, uint64_t x, uint8_t scale);
+
+// Writes a number as per 'json_gen_inum()'.
+void json_write_inum(JsonWriter *w, int64_t x, uint8_t scale);
+
+void json_write_bool(JsonWriter *w, bool x);
+
+void json_write_null(JsonWriter *w);
+
+// Writes a value that is already JSON (e.g. a span from a parsed message) verbatim.
+void json_write_raw(JsonWriter *w, JsonSpan v);
+
+// Like 'json_write_raw()', but with 'JSON_WRITER_IOV' the output references 'v' instead of
+// copying it, so 'v' must outlive the output.
+void json_write_raw_ref(JsonWriter *w, JsonSpan v);
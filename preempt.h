@@ -2,13 +2,27 @@
 
 #include "common.h"
 #include "fiber.h"
+#include "json_stats.h"
 
-enum { PREEMPT_DEFAULT_ALLOWANCE = 10000 };
+enum {
+    PREEMPT_DEFAULT_ALLOWANCE = 10000,
+    // The default number of steps between two clock checks of a timed device.
+    PREEMPT_DEFAULT_CHECK_INTERVAL = 1024,
+};
 
+// A preempt device yields after a number of steps (roughly, bytes of input) has been taken.
+//
+// A timed device ('preempt_new_timed()') yields once a time budget has been used up instead: it
+// checks the clock every 'allowance' steps and yields if the deadline has passed, so the time
+// between two yields is the budget plus at most 'allowance' steps. The deadline is set when the
+// device is created and each time the fiber is resumed.
 typedef struct {
     uint32_t left;
     uint32_t allowance;
     FiberParams fib_par;
+    // The budget in 'ticks_now()' ticks, or 0 for a device that is not timed.
+    uint64_t budget;
+    uint64_t deadline;
 } PreemptDevice;
 
 in_header PreemptDevice preempt_new(uint32_t allowance, FiberParams fib_par)
@@ -16,6 +30,9 @@ in_header PreemptDevice preempt_new(uint32_t allowance, FiberParams fib_par)
     if (!allowance) {
         allowance = PREEMPT_DEFAULT_ALLOWANCE;
     }
+#if JSON_STATS
+    json_stats_thread.run_start = ticks_now();
+#endif
     return (PreemptDevice) {
         .left      = allowance,
         .allowance = allowance,
@@ -23,25 +40,73 @@ in_header PreemptDevice preempt_new(uint32_t allowance, FiberParams fib_par)
     };
 }
 
+// Creates a timed device with a budget of 'budget_ns' nanoseconds (which must not be 0), checking
+// the clock every 'check_interval' steps; 0 means PREEMPT_DEFAULT_CHECK_INTERVAL.
+in_header PreemptDevice preempt_new_timed(uint64_t budget_ns, uint32_t check_interval, FiberParams fib_par)
+{
+    assert(budget_ns != 0);
+    if (!check_interval) {
+        check_interval = PREEMPT_DEFAULT_CHECK_INTERVAL;
+    }
+    PreemptDevice p = preempt_new(check_interval, fib_par);
+    p.budget = budget_ns * ticks_per_ns();
+    if (!p.budget) {
+        p.budget = 1;
+    }
+    p.deadline = ticks_now() + p.budget;
+    return p;
+}
+
+// Yields; with 'JSON_STATS', also records the time the fiber has run and keeps its stats site
+// across the switch.
+in_header void preempt_switch(PreemptDevice *p)
+{
+#if JSON_STATS
+    JsonStatsThread *t = &json_stats_thread;
+    JsonStatsSite *site = t->cur_site;
+    ++json_stats_counters()->yields;
+    json_stats_hist_add(&json_stats_counters()->run_ticks, ticks_now() - t->run_start);
+    t->cur_site = NULL;
+    fiber_yield(&p->fib_par);
+    t->cur_site = site;
+    t->run_start = ticks_now();
+#else
+    fiber_yield(&p->fib_par);
+#endif
+    if (p->budget) {
+        p->deadline = ticks_now() + p->budget;
+    }
+}
+
+// Called when 'left' has run out: refills it, then yields unless the device is timed and its
+// deadline has not passed yet.
+in_header void preempt_on_exhausted(PreemptDevice *p)
+{
+    p->left = p->allowance;
+    if (p->budget && ticks_now() < p->deadline)
+        return;
+    preempt_switch(p);
+}
+
 in_header void preempt_maybe_yield(PreemptDevice *p)
 {
+    JSON_STATS_ADD(yield_checks, 1);
     if (unlikely(!--p->left)) {
-        p->left = p->allowance;
-        fiber_yield(&p->fib_par);
+        preempt_on_exhausted(p);
     }
 }
 
 in_header void preempt_yield(PreemptDevice *p)
 {
     p->left = p->allowance;
-    fiber_yield(&p->fib_par);
+    preempt_switch(p);
 }
 
 in_header void preempt_maybe_yield_n(PreemptDevice *p, uint32_t n)
 {
+    JSON_STATS_ADD(yield_checks, 1);
     if (unlikely(p->left <= n)) {
-        p->left = p->allowance;
-        fiber_yield(&p->fib_par);
+        preempt_on_exhausted(p);
     } else {
         p->left -= n;
     }
@@ -0,0 +1,192 @@
+#include "psched.h"
+
+// Whether job 'a' is more urgent than job 'b'.
+static inline bool job_before(const PSchedJob *a, const PSchedJob *b)
+{
+    if (a->params.priority != b->params.priority)
+        return a->params.priority > b->params.priority;
+    // A zero deadline (no deadline) becomes UINT64_MAX here.
+    uint64_t da = a->params.deadline_ns - 1;
+    uint64_t db = b->params.deadline_ns - 1;
+    if (da != db)
+        return da < db;
+    return a->seq < b->seq;
+}
+
+static inline void queue_place(PSched *s, size_t i, PSchedJob *job)
+{
+    s->queue[i] = job;
+    job->qidx = i;
+}
+
+static void queue_sift_up(PSched *s, size_t i)
+{
+    PSchedJob *job = s->queue[i];
+    while (i) {
+        size_t parent = (i - 1) / 2;
+        if (!job_before(job, s->queue[parent]))
+            break;
+        queue_place(s, i, s->queue[parent]);
+        i = parent;
+    }
+    queue_place(s, i, job);
+}
+
+static void queue_sift_down(PSched *s, size_t i)
+{
+    PSchedJob *job = s->queue[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= s->nqueue)
+            break;
+        if (child + 1 < s->nqueue && job_before(s->queue[child + 1], s->queue[child]))
+            ++child;
+        if (!job_before(s->queue[child], job))
+            break;
+        queue_place(s, i, s->queue[child]);
+        i = child;
+    }
+    queue_place(s, i, job);
+}
+
+static void queue_push(PSched *s, PSchedJob *job)
+{
+    if (s->nqueue == s->capqueue) {
+        s->queue = x2realloc_or_die(s->queue, &s->capqueue, sizeof(PSchedJob *));
+    }
+    s->queue[s->nqueue] = job;
+    queue_sift_up(s, s->nqueue++);
+}
+
+static void queue_remove(PSched *s, PSchedJob *job)
+{
+    size_t i = job->qidx;
+    job->qidx = SIZE_MAX;
+    PSchedJob *last = s->queue[--s->nqueue];
+    if (i == s->nqueue)
+        return;
+    queue_place(s, i, last);
+    queue_sift_up(s, i);
+    queue_sift_down(s, last->qidx);
+}
+
+static Fiber *fiber_acquire(PSched *s)
+{
+    if (s->nfree_fibers)
+        return s->free_fibers[--s->nfree_fibers];
+    return malloc_or_die(1, sizeof(Fiber));
+}
+
+static void fiber_release(PSched *s, Fiber *fib)
+{
+    if (s->nfree_fibers == s->capfree_fibers) {
+        s->free_fibers = x2realloc_or_die(s->free_fibers, &s->capfree_fibers, sizeof(Fiber *));
+    }
+    s->free_fibers[s->nfree_fibers++] = fib;
+}
+
+static void job_fiber_main(FIBER_PARAM_LIST)
+{
+    PSchedJob *job = FIBER_GET_USERDATA();
+    PreemptDevice p = job->params.slice_ns
+        ? preempt_new_timed(job->params.slice_ns, job->params.allowance, FIBER_GET_PARAMS())
+        : preempt_new(job->params.allowance, FIBER_GET_PARAMS());
+    job->f(job, &p, job->userdata);
+    job->progress.state = PSCHED_JOB_DONE;
+}
+
+void psched_init(PSched *s)
+{
+    *s = (PSched) {0};
+}
+
+void psched_destroy(PSched *s)
+{
+    assert(s->nqueue == 0);
+    for (size_t i = 0; i < s->nfree_fibers; ++i) {
+        free(s->free_fibers[i]);
+    }
+    free(s->free_fibers);
+    free(s->queue);
+}
+
+void psched_submit(PSched *s, PSchedJob *job, PSchedJobFunc f, void *userdata, PSchedJobParams params)
+{
+    *job = (PSchedJob) {
+        .f        = f,
+        .userdata = userdata,
+        .params   = params,
+        .seq      = s->next_seq++,
+        .qidx     = SIZE_MAX,
+        .fib      = NULL,
+        .progress = {.state = PSCHED_JOB_QUEUED},
+    };
+    queue_push(s, job);
+}
+
+bool psched_cancel(PSched *s, PSchedJob *job)
+{
+    if (job->qidx == SIZE_MAX)
+        return false;
+    queue_remove(s, job);
+    if (job->fib) {
+        fiber_release(s, job->fib);
+        job->fib = NULL;
+    }
+    job->progress.state = PSCHED_JOB_CANCELLED;
+    return true;
+}
+
+void psched_reschedule(PSched *s, PSchedJob *job, int priority, uint64_t deadline_ns)
+{
+    job->params.priority = priority;
+    job->params.deadline_ns = deadline_ns;
+    if (job->qidx != SIZE_MAX) {
+        queue_sift_up(s, job->qidx);
+        queue_sift_down(s, job->qidx);
+    }
+}
+
+PSchedJob *psched_kick(PSched *s)
+{
+    if (!s->nqueue)
+        return NULL;
+
+    PSchedJob *job = s->queue[0];
+    queue_remove(s, job);
+
+    if (!job->fib) {
+        job->fib = fiber_acquire(s);
+        fiber_create(job->fib, job_fiber_main, job);
+    }
+
+    job->progress.state = PSCHED_JOB_RUNNING;
+    uint64_t t0 = psched_now_ns();
+    fiber_kick(job->fib);
+    uint64_t t1 = psched_now_ns();
+    job->progress.run_ns += t1 - t0;
+    ++job->progress.nslices;
+
+    if (job->params.deadline_ns && t1 > job->params.deadline_ns) {
+        job->progress.deadline_missed = true;
+    }
+
+    if (job->progress.state == PSCHED_JOB_DONE) {
+        fiber_release(s, job->fib);
+        job->fib = NULL;
+    } else {
+        job->progress.state = PSCHED_JOB_SUSPENDED;
+        queue_push(s, job);
+    }
+    return job;
+}
+
+size_t psched_run(PSched *s, uint64_t until_ns)
+{
+    while (s->nqueue) {
+        psched_kick(s);
+        if (until_ns && psched_now_ns() >= until_ns)
+            break;
+    }
+    return s->nqueue;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "common.h"
+#include "fiber.h"
+#include "preempt.h"
+
+// A scheduler that multiplexes many preemptible jobs (typically parses made with the 'PREEMPT_*'
+// functions) on the calling thread.
+//
+// Each job runs in its own fiber with its own 'PreemptDevice'. 'psched_kick()' resumes the most
+// urgent runnable job until it either yields or finishes; then control returns to the caller,
+// which may submit or cancel jobs before kicking again. The most urgent job is the one with the
+// highest priority; among these, the one with the earliest deadline (jobs without a deadline go
+// last); among these, the one submitted first.
+//
+// So that a large job does not delay small urgent ones, submit it with a lower priority (or a
+// later deadline) and a small allowance: every 'allowance' byte-steps it yields and the
+// scheduler gets a chance to switch to whatever has been submitted in the meantime. Or give it a
+// time slice ('slice_ns') instead, so that the latency it adds does not depend on how fast its
+// input happens to parse.
+//
+// Fibers are allocated lazily and reused; a job only occupies a fiber between its first kick and
+// its completion or cancellation.
+
+typedef struct PSchedJob PSchedJob;
+
+typedef void (*PSchedJobFunc)(PSchedJob *job, PreemptDevice *p, void *userdata);
+
+enum {
+    // Submitted, not yet started.
+    PSCHED_JOB_QUEUED,
+    // Started, suspended in a yield.
+    PSCHED_JOB_SUSPENDED,
+    // Being executed (only seen from inside the job).
+    PSCHED_JOB_RUNNING,
+    // Returned from its function.
+    PSCHED_JOB_DONE,
+    // Cancelled with 'psched_cancel()'.
+    PSCHED_JOB_CANCELLED,
+};
+
+typedef struct {
+    // Higher values are more urgent.
+    int priority;
+    // Absolute time (as per 'psched_now_ns()') the job should be done by; 0 means no deadline.
+    uint64_t deadline_ns;
+    // The allowance of the job's preempt device; 0 means PREEMPT_DEFAULT_ALLOWANCE.
+    uint32_t allowance;
+    // If non-zero, the job's preempt device is timed (see 'preempt_new_timed()'): it runs for about
+    // this long before yielding, and 'allowance' is the interval between clock checks instead (0
+    // then meaning PREEMPT_DEFAULT_CHECK_INTERVAL).
+    uint64_t slice_ns;
+} PSchedJobParams;
+
+// Per-job progress; see 'psched_job_progress()'.
+typedef struct {
+    uint8_t state;
+    // Whether the job was not done by its deadline.
+    bool deadline_missed;
+    // The number of times the job has been kicked.
+    uint64_t nslices;
+    // The total time spent inside of the job.
+    uint64_t run_ns;
+    // Whatever the job has reported with 'psched_job_report()'; e.g. bytes parsed out of total.
+    size_t done;
+    size_t total;
+} PSchedJobProgress;
+
+// The storage for a job is provided by the caller and must stay valid until the job is either
+// done or cancelled. Its fields are private to the scheduler.
+struct PSchedJob {
+    PSchedJobFunc f;
+    void *userdata;
+    PSchedJobParams params;
+    uint64_t seq;
+    // Index in the run queue, or SIZE_MAX if not in it.
+    size_t qidx;
+    Fiber *fib;
+    PSchedJobProgress progress;
+};
+
+typedef struct {
+    // The run queue: a binary heap of jobs, the most urgent one first.
+    PSchedJob **queue;
+    size_t nqueue;
+    size_t capqueue;
+    // Fibers not currently used by any job.
+    Fiber **free_fibers;
+    size_t nfree_fibers;
+    size_t capfree_fibers;
+    uint64_t next_seq;
+} PSched;
+
+in_header uint64_t psched_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void psched_init(PSched *s);
+
+// Frees the fibers. There must be no queued or suspended jobs left (cancel them first).
+void psched_destroy(PSched *s);
+
+// Queues 'job' that calls 'f(job, p, userdata)' in a fiber.
+void psched_submit(PSched *s, PSchedJob *job, PSchedJobFunc f, void *userdata, PSchedJobParams params);
+
+// Removes a queued or suspended job; a suspended one is never resumed, so it must not hold any
+// resources across yields that need to be released. Returns false if the job is already done or
+// cancelled.
+bool psched_cancel(PSched *s, PSchedJob *job);
+
+// Changes the priority and the deadline of a queued or suspended job.
+void psched_reschedule(PSched *s, PSchedJob *job, int priority, uint64_t deadline_ns);
+
+// Runs the most urgent job until it yields or finishes. Returns that job, or NULL if the run queue
+// is empty.
+PSchedJob *psched_kick(PSched *s);
+
+// Kicks jobs until either the run queue is empty or 'until_ns' (as per 'psched_now_ns()') has
+// passed; 0 means no time limit. Returns the number of jobs left in the run queue.
+size_t psched_run(PSched *s, uint64_t until_ns);
+
+in_header size_t psched_njobs(PSched *s)
+{
+    return s->nqueue;
+}
+
+in_header PSchedJobProgress psched_job_progress(PSchedJob *job)
+{
+    return job->progress;
+}
+
+// Called from inside of a job to report how far it has got.
+in_header void psched_job_report(PSchedJob *job, size_t done, size_t total)
+{
+    job->progress.done = done;
+    job->progress.total = total;
+}
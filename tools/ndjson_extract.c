@@ -0,0 +1,504 @@
+// Extracts fields from a newline-delimited JSON file into CSV or into a binary columnar format,
+// in parallel.
+//
+// Usage: ndjson_extract [-j NWORKERS] [-f csv|bin] [-o OUTPUT] [-b BLOCK_KIB] [-x] [-v] INPUT FIELD...
+//
+// Each 'FIELD' is a path of dict keys separated by dots, optionally followed by ':SCALE', e.g.
+// 'data.px:2'. Keys are matched like in 'json_parse_dict_fields()' (or, with '-x', like in
+// 'json_parse_dict_fields_exact()'). A field with a scale is a number parsed with
+// 'json_parse_num(..., SCALE)' (a quoted number, as in '"1.25"', is unquoted first); a field
+// without one is the text of the value.
+//
+// The input is mapped into memory and cut into blocks of about BLOCK_KIB KiB at line boundaries;
+// the workers extract the fields of whole blocks (with 'json_batch_parse()' on a pool of their
+// own) and format them into per-block buffers, which are written out in the input order. Empty
+// lines are skipped; lines that fail to parse are still output, with whatever fields were found
+// before the error.
+//
+// CSV output: a header line with the fields as given, then a line per input line. Numbers are
+// written back in decimal with 'SCALE' digits after the point; strings are unescaped; absent
+// values are empty. Values containing commas, quotes or line breaks are quoted.
+//
+// Binary output (all integers in native byte order): the magic "NDJCOL1\n", a 'uint32_t' number
+// of fields and, for each, an 'uint8_t' kind (0 for text, 1 for a number), an 'uint8_t' scale,
+// an 'uint16_t' length and the field as given. Then, for each block, a "row group": an 'uint64_t'
+// number of rows and, for each field, either an 'int64_t' per row (INT64_MIN if absent or not a
+// number), or an 'uint64_t' end offset per row followed by the concatenated texts of the values
+// (raw, as in the input; absent values are empty).
+
+#include "common.h"
+#include "json_batch.h"
+#include "json_gen_num.h"
+#include "json_visit.h"
+#include "workpool.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum {
+    // Blocks taken by a round of 'workpool_run()', per worker: their output is buffered until the
+    // round is written out.
+    BLOCKS_PER_WORKER = 4,
+    DEFAULT_BLOCK_KIB = 4096,
+};
+
+typedef struct {
+    char *data;
+    size_t n;
+    size_t cap;
+} Buf;
+
+static inline char *buf_reserve(Buf *b, size_t n)
+{
+    while (b->cap - b->n < n) {
+        b->data = x2realloc_or_die(b->data, &b->cap, 1);
+    }
+    return b->data + b->n;
+}
+
+static inline void buf_append(Buf *b, const void *p, size_t n)
+{
+    memcpy(buf_reserve(b, n), p, n);
+    b->n += n;
+}
+
+typedef struct {
+    const char *spec;
+    const char **path;
+    int npath;
+    // -1 for a text field.
+    int scale;
+} Field;
+
+typedef struct {
+    JsonSpan range;
+    Buf out;
+    size_t nrows;
+    size_t nfailed;
+} Block;
+
+// The scratch space of a worker, reused from block to block.
+typedef struct {
+    WorkPool *inline_pool;
+    JsonSpan *docs;
+    size_t capdocs;
+    int *status;
+    JsonSpan **spans;
+    int64_t **nums;
+    Buf scratch;
+} Worker;
+
+typedef struct {
+    const Field *fields;
+    int nfields;
+    bool binary;
+    unsigned batch_flags;
+    Block *blocks;
+    Worker *workers;
+} Job;
+
+static void die_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "USAGE: %s [-j NWORKERS] [-f csv|bin] [-o OUTPUT] [-b BLOCK_KIB] [-x] [-v] INPUT FIELD...\n",
+            argv0);
+    exit(2);
+}
+
+static Field parse_field(const char *spec)
+{
+    Field f = {.spec = spec, .scale = -1};
+    char *s = strdup_or_die(spec);
+    char *colon = strrchr(s, ':');
+    if (colon) {
+        *colon = '\0';
+        char *end;
+        long scale = strtol(colon + 1, &end, 10);
+        if (end == colon + 1 || *end || scale < 0 || scale > 18) {
+            fprintf(stderr, "Invalid scale in field '%s'.\n", spec);
+            exit(2);
+        }
+        f.scale = scale;
+    }
+    size_t cap = 0;
+    for (char *key = s;;) {
+        char *dot = strchr(key, '.');
+        if (dot) {
+            *dot = '\0';
+        }
+        if (!*key) {
+            fprintf(stderr, "Empty key in field '%s'.\n", spec);
+            exit(2);
+        }
+        if ((size_t) f.npath == cap) {
+            f.path = x2realloc_or_die(f.path, &cap, sizeof(char *));
+        }
+        f.path[f.npath++] = key;
+        if (!dot)
+            break;
+        key = dot + 1;
+    }
+    return f;
+}
+
+static bool csv_needs_quotes(const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        char c = s[i];
+        if (c == ',' || c == '"' || c == '\n' || c == '\r')
+            return true;
+    }
+    return false;
+}
+
+static void csv_append(Buf *b, const char *s, size_t n)
+{
+    if (!csv_needs_quotes(s, n)) {
+        buf_append(b, s, n);
+        return;
+    }
+    // At worst every character is a quote, doubled.
+    char *p = buf_reserve(b, 2 * n + 2);
+    *p++ = '"';
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] == '"') {
+            *p++ = '"';
+        }
+        *p++ = s[i];
+    }
+    *p++ = '"';
+    b->n = p - b->data;
+}
+
+static void format_csv(const Job *job, Worker *w, Block *blk, size_t ndocs)
+{
+    Buf *b = &blk->out;
+    for (size_t i = 0; i < ndocs; ++i) {
+        for (int f = 0; f < job->nfields; ++f) {
+            if (f) {
+                buf_append(b, ",", 1);
+            }
+            if (job->fields[f].scale >= 0) {
+                int64_t x = w->nums[f][i];
+                if (x != INT64_MIN) {
+                    char *p = buf_reserve(b, 24 + job->fields[f].scale);
+                    b->n += json_gen_inum(p, x, job->fields[f].scale);
+                }
+                continue;
+            }
+            JsonSpan v = w->spans[f][i];
+            if (!v.begin)
+                continue;
+            if (v.begin[0] == '"') {
+                // The unescaped string is not longer than the escaped one.
+                w->scratch.n = 0;
+                char *p = buf_reserve(&w->scratch, v.end - v.begin);
+                ssize_t n = json_unesc(v.begin, v.end, p);
+                if (n >= 0) {
+                    csv_append(b, p, n);
+                    continue;
+                }
+            }
+            csv_append(b, v.begin, v.end - v.begin);
+        }
+        buf_append(b, "\n", 1);
+    }
+}
+
+static void format_bin(const Job *job, Worker *w, Block *blk, size_t ndocs)
+{
+    Buf *b = &blk->out;
+    uint64_t nrows = ndocs;
+    buf_append(b, &nrows, sizeof(nrows));
+    for (int f = 0; f < job->nfields; ++f) {
+        if (job->fields[f].scale >= 0) {
+            buf_append(b, w->nums[f], ndocs * sizeof(int64_t));
+            continue;
+        }
+        uint64_t off = 0;
+        for (size_t i = 0; i < ndocs; ++i) {
+            JsonSpan v = w->spans[f][i];
+            off += v.end - v.begin;
+            buf_append(b, &off, sizeof(off));
+        }
+        for (size_t i = 0; i < ndocs; ++i) {
+            JsonSpan v = w->spans[f][i];
+            buf_append(b, v.begin, v.end - v.begin);
+        }
+    }
+}
+
+static void process_blocks(void *arg, size_t begin, size_t end, int worker)
+{
+    const Job *job = arg;
+    Worker *w = &job->workers[worker];
+
+    for (size_t k = begin; k < end; ++k) {
+        Block *blk = &job->blocks[k];
+        blk->out.n = 0;
+
+        size_t ndocs = 0;
+        for (const char *p = blk->range.begin, *e = blk->range.end; p != e;) {
+            const char *nl = memchr(p, '\n', e - p);
+            const char *line_end = nl ? nl : e;
+            JsonSpan line = {p, line_end};
+            p = nl ? nl + 1 : e;
+            if (line.end != line.begin && line.end[-1] == '\r') {
+                --line.end;
+            }
+            if (json_skip_ws(line.begin, line.end) == line.end)
+                continue;
+            if (ndocs == w->capdocs) {
+                size_t cap = w->capdocs;
+                w->docs = x2realloc_or_die(w->docs, &cap, sizeof(JsonSpan));
+                w->status = realloc_or_die(w->status, cap, sizeof(int));
+                for (int f = 0; f < job->nfields; ++f) {
+                    w->spans[f] = realloc_or_die(w->spans[f], cap, sizeof(JsonSpan));
+                    w->nums[f] = realloc_or_die(w->nums[f], cap, sizeof(int64_t));
+                }
+                w->capdocs = cap;
+            }
+            w->docs[ndocs++] = line;
+        }
+
+        JsonBatchField bfields[job->nfields];
+        for (int f = 0; f < job->nfields; ++f) {
+            bfields[f] = (JsonBatchField) {
+                .path = job->fields[f].path,
+                .npath = job->fields[f].npath,
+                .spans = w->spans[f],
+                .nums = job->fields[f].scale >= 0 ? w->nums[f] : NULL,
+                .scale = job->fields[f].scale >= 0 ? job->fields[f].scale : 0,
+            };
+        }
+        blk->nfailed = ndocs
+            ? json_batch_parse(w->inline_pool, w->docs, ndocs, bfields, job->nfields, w->status, job->batch_flags)
+            : 0;
+        blk->nrows = ndocs;
+
+        if (job->binary) {
+            format_bin(job, w, blk, ndocs);
+        } else {
+            format_csv(job, w, blk, ndocs);
+        }
+    }
+}
+
+static void write_or_die(FILE *f, const void *p, size_t n)
+{
+    if (n && fwrite(p, 1, n, f) != n) {
+        perror("fwrite");
+        exit(1);
+    }
+}
+
+static void write_header(FILE *out, const Field *fields, int nfields, bool binary)
+{
+    if (!binary) {
+        Buf b = {0};
+        for (int f = 0; f < nfields; ++f) {
+            if (f) {
+                buf_append(&b, ",", 1);
+            }
+            csv_append(&b, fields[f].spec, strlen(fields[f].spec));
+        }
+        buf_append(&b, "\n", 1);
+        write_or_die(out, b.data, b.n);
+        free(b.data);
+        return;
+    }
+    write_or_die(out, "NDJCOL1\n", 8);
+    uint32_t n = nfields;
+    write_or_die(out, &n, sizeof(n));
+    for (int f = 0; f < nfields; ++f) {
+        uint8_t kind = fields[f].scale >= 0;
+        uint8_t scale = kind ? fields[f].scale : 0;
+        uint16_t len = strlen(fields[f].spec);
+        write_or_die(out, &kind, 1);
+        write_or_die(out, &scale, 1);
+        write_or_die(out, &len, sizeof(len));
+        write_or_die(out, fields[f].spec, len);
+    }
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    int nworkers = 0;
+    bool binary = false;
+    bool verbose = false;
+    const char *out_path = NULL;
+    size_t block_size = (size_t) DEFAULT_BLOCK_KIB * 1024;
+    unsigned batch_flags = 0;
+
+    for (int c; (c = getopt(argc, argv, "j:f:o:b:xv")) != -1;) {
+        switch (c) {
+        case 'j':
+            nworkers = atoi(optarg);
+            break;
+        case 'f':
+            if (strcmp(optarg, "csv") == 0) {
+                binary = false;
+            } else if (strcmp(optarg, "bin") == 0) {
+                binary = true;
+            } else {
+                die_usage(argv[0]);
+            }
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'b':
+            block_size = (size_t) atol(optarg) * 1024;
+            if (!block_size) {
+                die_usage(argv[0]);
+            }
+            break;
+        case 'x':
+            batch_flags |= JSON_BATCH_EXACT;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            die_usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2) {
+        die_usage(argv[0]);
+    }
+    const char *in_path = argv[optind];
+    int nfields = argc - optind - 1;
+    Field *fields = malloc_or_die(nfields, sizeof(Field));
+    for (int f = 0; f < nfields; ++f) {
+        fields[f] = parse_field(argv[optind + 1 + f]);
+    }
+
+    int fd = open(in_path, O_RDONLY);
+    if (fd < 0) {
+        perror(in_path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(in_path);
+        return 1;
+    }
+    size_t size = st.st_size;
+    const char *base = NULL;
+    if (size) {
+        void *m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        // Hints only: failures are harmless.
+        (void) madvise(m, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        (void) madvise(m, size, MADV_HUGEPAGE);
+#endif
+        base = m;
+    }
+    close(fd);
+
+    FILE *out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "wb");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    double t0 = now_s();
+
+    WorkPool *wp = workpool_new(nworkers);
+    nworkers = workpool_nworkers(wp);
+    Worker *workers = calloc_or_die(nworkers, sizeof(Worker));
+    for (int i = 0; i < nworkers; ++i) {
+        workers[i].inline_pool = workpool_new(1);
+        workers[i].spans = calloc_or_die(nfields, sizeof(JsonSpan *));
+        workers[i].nums = calloc_or_die(nfields, sizeof(int64_t *));
+    }
+    size_t nblocks_per_round = (size_t) nworkers * BLOCKS_PER_WORKER;
+    Block *blocks = calloc_or_die(nblocks_per_round, sizeof(Block));
+    Job job = {
+        .fields = fields,
+        .nfields = nfields,
+        .binary = binary,
+        .batch_flags = batch_flags,
+        .blocks = blocks,
+        .workers = workers,
+    };
+
+    write_header(out, fields, nfields, binary);
+
+    size_t nrows = 0;
+    size_t nfailed = 0;
+    for (size_t pos = 0; pos < size;) {
+        // Cut the next round of blocks at line boundaries.
+        size_t nblocks = 0;
+        while (nblocks < nblocks_per_round && pos < size) {
+            size_t end = size - pos > block_size ? pos + block_size : size;
+            if (end < size) {
+                const char *nl = memchr(base + end, '\n', size - end);
+                end = nl ? (size_t) (nl - base) + 1 : size;
+            }
+            blocks[nblocks++].range = (JsonSpan) {base + pos, base + end};
+            pos = end;
+        }
+
+        workpool_run(wp, nblocks, 1, process_blocks, &job);
+
+        for (size_t k = 0; k < nblocks; ++k) {
+            write_or_die(out, blocks[k].out.data, blocks[k].out.n);
+            nrows += blocks[k].nrows;
+            nfailed += blocks[k].nfailed;
+        }
+    }
+
+    if (fflush(out) != 0 || (out != stdout && fclose(out) != 0)) {
+        perror("write");
+        return 1;
+    }
+
+    if (verbose) {
+        double t = now_s() - t0;
+        fprintf(stderr, "%zu lines (%zu failed), %zu bytes in %.3f s: %.2f GB/s with %d workers\n",
+                nrows, nfailed, size, t, size / t * 1e-9, nworkers);
+    }
+    if (nfailed) {
+        fprintf(stderr, "%zu lines failed to parse.\n", nfailed);
+    }
+
+    for (size_t k = 0; k < nblocks_per_round; ++k) {
+        free(blocks[k].out.data);
+    }
+    for (int i = 0; i < nworkers; ++i) {
+        workpool_free(workers[i].inline_pool);
+        free(workers[i].docs);
+        free(workers[i].status);
+        for (int f = 0; f < nfields; ++f) {
+            free(workers[i].spans[f]);
+            free(workers[i].nums[f]);
+        }
+        free(workers[i].spans);
+        free(workers[i].nums);
+        free(workers[i].scratch.data);
+    }
+    free(workers);
+    free(blocks);
+    workpool_free(wp);
+    if (size) {
+        munmap((void *) base, size);
+    }
+    return nfailed ? 3 : 0;
+}
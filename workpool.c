@@ -0,0 +1,177 @@
+#include "workpool.h"
+
+typedef struct {
+    // The next item to be taken; may go past 'end'.
+    size_t next;
+    size_t end;
+} __attribute__((aligned(64))) WorkRange;
+
+struct WorkPool {
+    int nworkers;
+    pthread_t *threads;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cv_start;
+    pthread_cond_t cv_done;
+    // Incremented for each 'workpool_run()'; workers wait for it to change.
+    uint64_t generation;
+    // The number of threads (other than the caller) still working on the current generation.
+    int nbusy;
+    bool quit;
+
+    WorkPoolFunc f;
+    void *arg;
+    size_t chunk;
+    WorkRange *ranges;
+};
+
+typedef struct {
+    WorkPool *wp;
+    int worker;
+} WorkerArg;
+
+// Takes a chunk from range 'r'. Returns false if the range is exhausted.
+static inline bool range_take(WorkRange *r, size_t chunk, size_t *begin, size_t *end)
+{
+    if (__atomic_load_n(&r->next, __ATOMIC_RELAXED) >= r->end)
+        return false;
+    size_t b = __atomic_fetch_add(&r->next, chunk, __ATOMIC_RELAXED);
+    if (b >= r->end)
+        return false;
+    *begin = b;
+    *end = r->end - b < chunk ? r->end : b + chunk;
+    return true;
+}
+
+static void work(WorkPool *wp, int worker)
+{
+    size_t begin;
+    size_t end;
+    for (int i = 0; i < wp->nworkers; ++i) {
+        // Our own range first, then the others'.
+        WorkRange *r = &wp->ranges[(worker + i) % wp->nworkers];
+        while (range_take(r, wp->chunk, &begin, &end)) {
+            wp->f(wp->arg, begin, end, worker);
+        }
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    WorkerArg wa = *(WorkerArg *) arg;
+    free(arg);
+    WorkPool *wp = wa.wp;
+
+    uint64_t seen = 0;
+    pthread_mutex_lock(&wp->mtx);
+    for (;;) {
+        while (wp->generation == seen && !wp->quit) {
+            pthread_cond_wait(&wp->cv_start, &wp->mtx);
+        }
+        if (wp->quit)
+            break;
+        seen = wp->generation;
+        pthread_mutex_unlock(&wp->mtx);
+
+        work(wp, wa.worker);
+
+        pthread_mutex_lock(&wp->mtx);
+        if (--wp->nbusy == 0) {
+            pthread_cond_signal(&wp->cv_done);
+        }
+    }
+    pthread_mutex_unlock(&wp->mtx);
+    return NULL;
+}
+
+WorkPool *workpool_new(int nworkers)
+{
+    if (nworkers <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = n > 0 ? n : 1;
+    }
+
+    WorkPool *wp = calloc_or_die(1, sizeof(WorkPool));
+    wp->nworkers = nworkers;
+    wp->threads = calloc_or_die(nworkers, sizeof(pthread_t));
+    wp->ranges = aligned_alloc(_Alignof(WorkRange), nworkers * sizeof(WorkRange));
+    if (!wp->ranges)
+        die_out_of_memory();
+    pthread_mutex_init(&wp->mtx, NULL);
+    pthread_cond_init(&wp->cv_start, NULL);
+    pthread_cond_init(&wp->cv_done, NULL);
+
+    for (int i = 1; i < nworkers; ++i) {
+        WorkerArg *wa = malloc_or_die(1, sizeof(WorkerArg));
+        *wa = (WorkerArg) {.wp = wp, .worker = i};
+        int rc = pthread_create(&wp->threads[i], NULL, worker_main, wa);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+            abort();
+        }
+    }
+    return wp;
+}
+
+void workpool_free(WorkPool *wp)
+{
+    pthread_mutex_lock(&wp->mtx);
+    wp->quit = true;
+    pthread_cond_broadcast(&wp->cv_start);
+    pthread_mutex_unlock(&wp->mtx);
+
+    for (int i = 1; i < wp->nworkers; ++i) {
+        pthread_join(wp->threads[i], NULL);
+    }
+    pthread_cond_destroy(&wp->cv_done);
+    pthread_cond_destroy(&wp->cv_start);
+    pthread_mutex_destroy(&wp->mtx);
+    free(wp->ranges);
+    free(wp->threads);
+    free(wp);
+}
+
+int workpool_nworkers(const WorkPool *wp)
+{
+    return wp->nworkers;
+}
+
+void workpool_run(WorkPool *wp, size_t nitems, size_t chunk, WorkPoolFunc f, void *arg)
+{
+    if (!nitems)
+        return;
+
+    size_t n = wp->nworkers;
+    if (!chunk) {
+        chunk = nitems / (16 * n);
+        if (!chunk)
+            chunk = 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        wp->ranges[i] = (WorkRange) {
+            .next = nitems * i / n,
+            .end  = nitems * (i + 1) / n,
+        };
+    }
+    wp->f = f;
+    wp->arg = arg;
+    wp->chunk = chunk;
+
+    if (n > 1) {
+        pthread_mutex_lock(&wp->mtx);
+        wp->nbusy = n - 1;
+        ++wp->generation;
+        pthread_cond_broadcast(&wp->cv_start);
+        pthread_mutex_unlock(&wp->mtx);
+    }
+
+    work(wp, 0);
+
+    if (n > 1) {
+        pthread_mutex_lock(&wp->mtx);
+        while (wp->nbusy) {
+            pthread_cond_wait(&wp->cv_done, &wp->mtx);
+        }
+        pthread_mutex_unlock(&wp->mtx);
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common.h"
+
+// A pool of worker threads for data-parallel loops over 'nitems' independent items.
+//
+// 'workpool_run()' splits the items into one contiguous range per worker; each worker takes
+// 'chunk' items at a time from the front of its own range and, once it is exhausted, steals
+// chunks from the ranges of the others. The calling thread takes part as worker 0, so a pool of
+// one worker runs everything inline.
+
+// Called for items {begin ... end}; 'worker' is the index of the calling worker,
+// 0 <= worker < workpool_nworkers().
+typedef void (*WorkPoolFunc)(void *arg, size_t begin, size_t end, int worker);
+
+typedef struct WorkPool WorkPool;
+
+// Creates a pool of 'nworkers' workers (including the calling thread); if 'nworkers' <= 0, of as
+// many as there are online CPUs.
+WorkPool *workpool_new(int nworkers);
+
+void workpool_free(WorkPool *wp);
+
+int workpool_nworkers(const WorkPool *wp);
+
+// Calls 'f' on all the items and waits until it is done. If 'chunk' is 0, a chunk size that gives
+// each worker about 16 chunks is used.
+//
+// Only one thread may call this on the same pool at a time.
+void workpool_run(WorkPool *wp, size_t nitems, size_t chunk, WorkPoolFunc f, void *arg);